@@ -0,0 +1,29 @@
+// Book titles for the benchmarks: two to seven words drawn from a short list
+// of programming-book vocabulary, so that searches hit realistic term
+// frequencies. Shared by ScanBenchmark.cpp and LibraryBenchmark.cpp.
+#ifndef BENCHMARK_TITLES_H
+#define BENCHMARK_TITLES_H
+
+#include <random>
+#include <string>
+
+inline std::string generateTitle(std::mt19937 &rng)
+{
+    static const char *words[] = {"Introduction", "to", "Algorithms", "Modern", "Operating", "Systems", "Deep",
+                                  "Learning", "the", "C++", "Programming", "Language", "Design", "Patterns",
+                                  "Data", "Structures", "Networks", "Concurrency", "in", "Action", "Clean",
+                                  "Code", "Database", "Management", "Artificial", "Intelligence", "Python"};
+    const size_t wordCount = sizeof(words) / sizeof(words[0]);
+
+    std::string title;
+    size_t length = 2 + rng() % 6;
+    for (size_t w = 0; w < length; w++)
+    {
+        if (w > 0)
+            title += ' ';
+        title += words[rng() % wordCount];
+    }
+    return title;
+}
+
+#endif
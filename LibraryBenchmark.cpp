@@ -0,0 +1,326 @@
+// Benchmark for every LibraryService operation on a generated data set:
+// load, display, search, add, edit, remove, borrow, return, fee report,
+// login and the final save. Each phase calls the service directly, with no
+// menus or sockets in the way, and prints one JSON line:
+//
+//   {"op":"search","books":10000,"patrons":1000,"count":1000,"seconds":0.041,
+//    "ops_per_sec":24390.2,"p50_us":38.1,"p99_us":92.7,"peak_rss_kb":18204,
+//    "bytes_written":0}
+//
+// The fields and their order are fixed so that runs can be compared line
+// by line. peak_rss_kb is the process peak so far; bytes_written is what
+// the phase itself wrote, or -1 where the platform cannot tell.
+//
+// Build: g++ -std=c++17 -O2 -pthread -o library_benchmark LibraryBenchmark.cpp
+// Usage: library_benchmark [--books N] [--patrons N] [--ops N] [--max-seconds S]
+//                          [--hash-iterations N] [--group-commit N] [--dir PATH]
+#define LIBRARY_SYSTEM_NO_MAIN
+#include "LibrarySystem_fixed.cpp"
+#include "BenchmarkTitles.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+struct BenchmarkConfig
+{
+    size_t books = 10000;
+    size_t patrons = 0;
+    size_t ops = 1000;
+    double maxSeconds = 10;
+    int hashIterations = defaultHashIterations;
+    int groupCommit = 0;
+    string dir = "library-bench";
+};
+
+const char *benchmarkPassword = "bench";
+
+long long peakRssKb()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return -1;
+    return static_cast<long long>(counters.PeakWorkingSetSize / 1024);
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+// Bytes handed to write calls by this process, whether or not they have
+// reached the disk yet.
+long long bytesWrittenSoFar()
+{
+#ifdef _WIN32
+    IO_COUNTERS counters;
+    if (!GetProcessIoCounters(GetCurrentProcess(), &counters))
+        return -1;
+    return static_cast<long long>(counters.WriteTransferCount);
+#else
+    ifstream io("/proc/self/io");
+    string key;
+    long long value;
+    while (io >> key >> value)
+    {
+        if (key == "wchar:")
+            return value;
+    }
+    return -1;
+#endif
+}
+
+// Writes books.txt, patrons.txt and loans.txt in the formats the service
+// reads, and removes whatever an earlier run left behind. Patron 1 is the
+// admin. Every patron shares one password hash, so generating a million of
+// them costs one hash rather than a million. A tenth of the patrons hold a
+// loan that is 30 days overdue, so the fee report has work to do.
+bool generateDataSet(const BenchmarkConfig &config)
+{
+    for (const char *name : {"books.bin", "library.journal", "library.meta", "library.lock", "users.txt",
+                             "People.txt"})
+    {
+        remove(name);
+    }
+
+    mt19937 rng(42);
+    AtomicFileWriter booksOut("books.txt");
+    booksOut.write("ID,Title,Author,Year,Copies\n");
+    for (size_t id = 1; id <= config.books; id++)
+    {
+        Book book = {static_cast<int>(id), generateTitle(rng), "Author " + to_string(rng() % 10000),
+                     static_cast<int>(1950 + rng() % 75), static_cast<int>(1 + rng() % 5)};
+        booksOut.write(formatBook(book));
+        booksOut.write("\n");
+    }
+
+    string credential = hashPassword(benchmarkPassword, config.hashIterations);
+    AtomicFileWriter patronsOut("patrons.txt");
+    patronsOut.write("\"ID\", \"Username\", \"Name\", \"Role\", \"Password\", \"Late Fees\", \"Fees Through\"\n");
+    for (size_t id = 1; id <= config.patrons; id++)
+    {
+        UserRole role = (id == 1) ? ADMIN : (id % 10 == 0) ? FACULTY : STUDENT;
+        Person person = {static_cast<int>(id), "user" + to_string(id), "Patron " + to_string(id), role,
+                         credential, 0, 0};
+        patronsOut.write(formatPatron(person));
+        patronsOut.write("\n");
+    }
+
+    int today = 0;
+    localToday(today);
+    AtomicFileWriter loansOut("loans.txt");
+    loansOut.write("\"User ID\", \"Book ID\", \"Borrowed\", \"Due Date\"\n");
+    for (size_t id = 2; id <= config.patrons && config.books > 0; id += 10)
+    {
+        Loan loan = {static_cast<int>(id), static_cast<int>(1 + rng() % config.books), today - 60, today - 30};
+        loansOut.write(formatLoan(loan));
+        loansOut.write("\n");
+    }
+
+    return booksOut.commit() && patronsOut.commit() && loansOut.commit();
+}
+
+// Calls step(i) for i = 0, 1, ... until count calls have been made or
+// maxSeconds have passed, and prints the phase's line. step returns false
+// to stop early, for example when it runs out of work. The phase ends with
+// a sync of the journal, so that with group commit the time to make the
+// phase's changes durable is counted, as batch mode counts it.
+template <typename Step>
+void runPhase(const char *op, const BenchmarkConfig &config, const unique_ptr<LibraryService> &service, size_t count,
+              Step step)
+{
+    vector<double> latencies;
+    latencies.reserve(count);
+    long long writtenBefore = bytesWrittenSoFar();
+    auto started = chrono::steady_clock::now();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        auto before = chrono::steady_clock::now();
+        bool more = step(i);
+        auto after = chrono::steady_clock::now();
+        latencies.push_back(chrono::duration<double, micro>(after - before).count());
+        if (!more || chrono::duration<double>(after - started).count() >= config.maxSeconds)
+            break;
+    }
+    if (service)
+        service->sync();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    long long writtenAfter = bytesWrittenSoFar();
+    long long written = (writtenBefore < 0 || writtenAfter < 0) ? -1 : writtenAfter - writtenBefore;
+
+    sort(latencies.begin(), latencies.end());
+    size_t n = latencies.size();
+    double p50 = n ? latencies[n / 2] : 0;
+    double p99 = n ? latencies[min(n - 1, n * 99 / 100)] : 0;
+    double rate = (seconds > 0) ? n / seconds : 0;
+
+    printf("{\"op\":\"%s\",\"books\":%zu,\"patrons\":%zu,\"count\":%zu,\"seconds\":%.6f,\"ops_per_sec\":%.1f,"
+           "\"p50_us\":%.1f,\"p99_us\":%.1f,\"peak_rss_kb\":%lld,\"bytes_written\":%lld}\n",
+           op, config.books, config.patrons, n, seconds, rate, p50, p99, peakRssKb(), written);
+    fflush(stdout);
+}
+
+bool parseSize(const char *text, size_t &value)
+{
+    int parsed = 0;
+    if (!parseInt(text, parsed) || parsed < 0)
+        return false;
+    value = static_cast<size_t>(parsed);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchmarkConfig config;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        bool ok = i + 1 < argc;
+        if (ok && arg == "--books")
+            ok = parseSize(argv[++i], config.books);
+        else if (ok && arg == "--patrons")
+            ok = parseSize(argv[++i], config.patrons);
+        else if (ok && arg == "--ops")
+            ok = parseSize(argv[++i], config.ops);
+        else if (ok && arg == "--max-seconds")
+            ok = (config.maxSeconds = atof(argv[++i])) > 0;
+        else if (ok && arg == "--hash-iterations")
+            ok = parseInt(argv[++i], config.hashIterations) && config.hashIterations > 0;
+        else if (ok && arg == "--group-commit")
+            ok = parseInt(argv[++i], config.groupCommit) && config.groupCommit > 0;
+        else if (ok && arg == "--dir")
+            config.dir = argv[++i];
+        else
+            ok = false;
+
+        if (!ok)
+        {
+            cerr << "Usage: library_benchmark [--books N] [--patrons N] [--ops N] [--max-seconds S]\n"
+                    "                         [--hash-iterations N] [--group-commit N] [--dir PATH]\n";
+            return 1;
+        }
+    }
+    if (config.patrons == 0)
+    {
+        config.patrons = config.books / 10;
+    }
+    config.patrons = max<size_t>(config.patrons, 10);
+
+#ifdef _WIN32
+    _mkdir(config.dir.c_str());
+    bool entered = _chdir(config.dir.c_str()) == 0;
+#else
+    mkdir(config.dir.c_str(), 0755);
+    bool entered = chdir(config.dir.c_str()) == 0;
+#endif
+    if (!entered || !generateDataSet(config))
+    {
+        cerr << "Error: Could not write the data set to " << config.dir << "\n";
+        return 1;
+    }
+
+    ServiceOptions options;
+    options.hashIterations = config.hashIterations;
+    if (config.groupCommit > 0)
+    {
+        options.groupCommitRecords = config.groupCommit;
+    }
+
+    unique_ptr<LibraryService> service;
+    runPhase("load", config, service, 1, [&](size_t)
+    {
+        service = make_unique<LibraryService>(options);
+        return true;
+    });
+
+    mt19937 rng(7);
+    const int bookLimit = static_cast<int>(config.books);
+    const int patronLimit = static_cast<int>(config.patrons);
+    Session admin = {1, "user1", ADMIN};
+    auto patron = [&](size_t i)
+    {
+        int id = 2 + static_cast<int>(i % (config.patrons - 1));
+        return Session{id, "user" + to_string(id), (id % 10 == 0) ? FACULTY : STUDENT};
+    };
+
+    runPhase("display", config, service, config.ops, [&](size_t)
+    {
+        int afterId = static_cast<int>(rng() % max(1, bookLimit));
+        service->listBooks(afterId, 20);
+        return true;
+    });
+
+    static const char *queries[] = {"ta", "in", "deep learning", "python", "concurrency in action",
+                                    "design patterns", "Author 42", "systems"};
+    runPhase("search", config, service, config.ops, [&](size_t i)
+    {
+        service->search(queries[i % (sizeof(queries) / sizeof(queries[0]))]);
+        return true;
+    });
+
+    vector<int> added;
+    runPhase("add", config, service, config.ops, [&](size_t)
+    {
+        Book book = {0, generateTitle(rng), "Benchmark Author", 2024, 3};
+        BookResult result = service->addBook(admin, book);
+        if (result.ok)
+            added.push_back(result.book.id);
+        return result.ok;
+    });
+
+    runPhase("edit", config, service, config.ops, [&](size_t)
+    {
+        int id = 1 + static_cast<int>(rng() % max(1, bookLimit));
+        Book book = {id, generateTitle(rng), "Edited Author", 2025, 4};
+        return service->editBook(admin, book, service->findBook(id).book.copies).ok;
+    });
+
+    runPhase("remove", config, service, added.size(), [&](size_t i)
+    {
+        return service->removeBook(admin, added[i]).ok;
+    });
+
+    vector<pair<Session, int>> borrowed;
+    runPhase("borrow", config, service, config.ops, [&](size_t i)
+    {
+        Session session = patron(i);
+        int bookId = 1 + static_cast<int>(rng() % max(1, bookLimit));
+        if (service->borrow(session, bookId).ok)
+            borrowed.push_back({session, bookId});
+        return true;
+    });
+
+    runPhase("return", config, service, borrowed.size(), [&](size_t i)
+    {
+        return service->returnBook(borrowed[i].first, borrowed[i].second).ok;
+    });
+
+    runPhase("fees", config, service, config.ops, [&](size_t)
+    {
+        return service->lateFees(admin).ok;
+    });
+
+    runPhase("login", config, service, config.ops, [&](size_t)
+    {
+        int id = 1 + static_cast<int>(rng() % max(1, patronLimit));
+        return service->login("user" + to_string(id), benchmarkPassword).ok;
+    });
+
+    runPhase("save", config, service, 1, [&](size_t)
+    {
+        service->compact();
+        return true;
+    });
+    return 0;
+}
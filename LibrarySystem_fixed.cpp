@@ -1,15 +1,49 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <string_view>
+#include <charconv>
 #include <vector>
 #include <ctime>
 #include <map>
-#include <sstream>
+#include <set>
+#include <unordered_map>
+#include <cstdint>
+#include <cmath>
 #include <algorithm>
 #include <cctype>
 #include <limits>
 #include <chrono>
 #include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <condition_variable>
+#include <deque>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#define NOMINMAX
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
 using namespace std;
 
 enum UserRole
@@ -19,1642 +53,7001 @@ enum UserRole
     STUDENT
 };
 
-void saveBooks(const vector<vector<string>> &books)
+string_view trimField(string_view field)
 {
-    ofstream booksOut("books.txt");
-    if (!booksOut.is_open())
-    {
-        cerr << "Error: Could not open books file for writing!" << endl;
-        return;
-    }
+    size_t begin = field.find_first_not_of(" \t\r");
+    if (begin == string_view::npos)
+        return string_view();
+    size_t end = field.find_last_not_of(" \t\r");
+    return field.substr(begin, end - begin + 1);
+}
 
-    booksOut << "ID,Title,Author,Year,Copies\n";
-    for (const auto &book : books)
+// Splits one CSV record into trimmed, unquoted fields without allocating.
+// Commas inside double quotes do not split. The views point into line and
+// stay valid only as long as the underlying buffer does. Returns the number
+// of fields found, which may exceed maxFields; extra fields are not stored.
+size_t splitRecord(string_view line, string_view *fields, size_t maxFields)
+{
+    size_t count = 0;
+    size_t start = 0;
+    bool inQuotes = false;
+
+    for (size_t i = 0; i <= line.size(); i++)
     {
-        booksOut << book[0] << ", \"" << book[1] << "\", \"" << book[2] << "\", "
-                 << book[3] << ", " << book[4] << "\n";
+        if (i < line.size())
+        {
+            char c = line[i];
+            if (c == '\"')
+            {
+                inQuotes = !inQuotes;
+                continue;
+            }
+            if (c != ',' || inQuotes)
+                continue;
+        }
+
+        if (count < maxFields)
+        {
+            string_view field = trimField(line.substr(start, i - start));
+            if (field.size() >= 2 && field.front() == '\"' && field.back() == '\"')
+                field = trimField(field.substr(1, field.size() - 2));
+            fields[count] = field;
+        }
+        count++;
+        start = i + 1;
     }
-    booksOut.close();
+    return count;
 }
 
-class Library
+bool parseInt(string_view text, int &value)
 {
-private:
-    static int next_id;
-    int current_user_id;
-    string current_username;
-    string current_password;
-    UserRole current_role;
-    bool is_logged_in;
-
-    map<string, UserRole> roleMap = {
-        {"ADMIN", ADMIN},
-        {"FACULTY", FACULTY},
-        {"STUDENT", STUDENT}};
-
-public:
-    Library();
-
-    void signup();
-    void login();
-    void logout();
-    void displayBooks(bool returnToMenu = true);
-    void searchBooks();
-    void addBook();
-    void editBook();
-    void removeBook();
-    void borrowBook();
-    void returnBook();
-    void checkLateFees();
-    void viewBorrowedBooks(bool returnToMenu = true);
-    void showMainMenu();
-    void showUserMenu();
-    void createDefaultFiles();
-    double calculateLateFees(const string &dueDate, UserRole role);
-    bool checkFileExists(const string &filename);
-    string cleanString(const string &input);
-};
+    const char *end = text.data() + text.size();
+    auto result = from_chars(text.data(), end, value);
+    return result.ec == errc() && result.ptr == end;
+}
 
-int Library::next_id = 15;
+// Dates are held as days since 1970-01-01, so ordering and fee arithmetic
+// are plain integer operations. The conversions use the era-based civil
+// calendar algorithm, which needs no month-length tables or loops.
+int daysFromCivil(int year, int month, int day)
+{
+    year -= month <= 2;
+    const int era = (year >= 0 ? year : year - 399) / 400;
+    const int yearOfEra = year - era * 400;
+    const int dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
 
-Library::Library()
+void civilFromDays(int days, int &year, int &month, int &day)
 {
-    current_user_id = 0;
-    current_username = "";
-    current_password = "";
-    current_role = STUDENT;
-    is_logged_in = false;
+    days += 719468;
+    const int era = (days >= 0 ? days : days - 146096) / 146097;
+    const int dayOfEra = days - era * 146097;
+    const int yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    const int dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    const int shiftedMonth = (5 * dayOfYear + 2) / 153;
+    day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+    month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+    year = yearOfEra + era * 400 + (month <= 2);
 }
 
-string Library::cleanString(const string &input)
+bool parseDate(string_view text, int &days)
 {
-    string cleaned;
-    for (char c : input)
+    int year, month, day;
+    if (text.size() != 10 || text[4] != '-' || text[7] != '-' || !parseInt(text.substr(0, 4), year) ||
+        !parseInt(text.substr(5, 2), month) || !parseInt(text.substr(8, 2), day) || month < 1 || month > 12 ||
+        day < 1 || day > 31)
     {
-        if (c != '\"' && c != '\'' && c != '\\')
-        {
-            cleaned += c;
-        }
+        return false;
     }
-    cleaned.erase(0, cleaned.find_first_not_of(" \t"));
-    cleaned.erase(cleaned.find_last_not_of(" \t") + 1);
-    return cleaned;
+
+    // Round-trip to reject days past the end of the month, e.g. 2023-02-30.
+    days = daysFromCivil(year, month, day);
+    int checkYear, checkMonth, checkDay;
+    civilFromDays(days, checkYear, checkMonth, checkDay);
+    return checkDay == day;
 }
 
-bool Library::checkFileExists(const string &filename)
+string formatDate(int days)
 {
-    ifstream file(filename);
-    return file.good();
+    int year, month, day;
+    civilFromDays(days, year, month, day);
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d", year, month, day);
+    return buffer;
 }
 
-void Library::createDefaultFiles()
+// The only place that consults the clock and time zone. Callers read it once
+// per operation and pass the day number down.
+bool localToday(int &days)
 {
-    ofstream booksFile("books.txt");
-    if (booksFile.is_open())
+    time_t now = time(0);
+    tm today;
+#ifdef _WIN32
+    if (now == -1 || localtime_s(&today, &now) != 0)
+#else
+    if (now == -1 || !localtime_r(&now, &today))
+#endif
     {
-        booksFile << "ID,Title,Author,Year,Copies\n";
+        return false;
+    }
 
-        booksFile << "1,\"C++ Programming Basics\",\"John Doe\",2019,5\n";
-        booksFile << "2,\"Data Structures and Algorithms\",\"Jane Smith\",2020,3\n";
-        booksFile << "3,\"Introduction to Machine Learning\",\"Alice Brown\",2021,2\n";
-        booksFile << "4,\"Database Management Systems\",\"Robert White\",2018,4\n";
-        booksFile << "5,\"The C++ Standard Library\",\"Bjarne Stroustrup\",2022,6\n";
-        booksFile << "6,\"Artificial Intelligence: A Modern Approach\",\"Stuart Russell\",2021,3\n";
-        booksFile << "7,\"Operating Systems Concepts\",\"Abraham Silberschatz\",2017,5\n";
-        booksFile << "8,\"Computer Networks\",\"Andrew Tanenbaum\",2019,2\n";
-        booksFile << "9,\"Clean Code\",\"Robert C. Martin\",2008,4\n";
-        booksFile << "10,\"The Pragmatic Programmer\",\"Andy Hunt\",1999,2\n";
-        booksFile << "11,\"Design Patterns\",\"Erich Gamma\",1994,3\n";
-        booksFile << "12,\"C++ Concurrency in Action\",\"Anthony Williams\",2020,2\n";
-        booksFile << "13,\"Python for Data Analysis\",\"Wes McKinney\",2018,4\n";
-        booksFile << "14,\"Learning React\",\"Alex Banks\",2022,6\n";
-        booksFile << "15,\"Introduction to Algorithms\",\"Thomas H. Cormen\",2009,5\n";
-        booksFile << "16,\"Hands-On Machine Learning\",\"Aurélien Géron\",2023,3\n";
-        booksFile << "17,\"Deep Learning\",\"Ian Goodfellow\",2016,2\n";
-        booksFile << "18,\"Head First Design Patterns\",\"Eric Freeman\",2004,4\n";
-        booksFile << "19,\"Computer Organization and Design\",\"David A. Patterson\",2021,3\n";
-        booksFile << "20,\"Modern Operating Systems\",\"Andrew S. Tanenbaum\",2018,5\n";
+    days = daysFromCivil(today.tm_year + 1900, today.tm_mon + 1, today.tm_mday);
+    return true;
+}
 
-        booksFile.close();
+// Reads amounts written by formatCents, as well as the bare "$0" and
+// one-decimal forms older files used.
+bool parseCents(string_view text, long long &cents)
+{
+    if (!text.empty() && text.front() == '$')
+        text.remove_prefix(1);
+
+    size_t dot = text.find('.');
+    string_view whole = text.substr(0, dot);
+    string_view fraction = (dot == string_view::npos) ? string_view() : text.substr(dot + 1);
+    long long units;
+    int fractionCents = 0;
+    auto result = from_chars(whole.data(), whole.data() + whole.size(), units);
+    if (result.ec != errc() || result.ptr != whole.data() + whole.size() || units < 0 || fraction.size() > 2 ||
+        (!fraction.empty() && !parseInt(fraction, fractionCents)) || fractionCents < 0)
+    {
+        return false;
     }
 
-    ofstream peopleFile("People.txt");
-    if (peopleFile.is_open())
+    cents = units * 100 + (fraction.size() == 1 ? fractionCents * 10 : fractionCents);
+    return true;
+}
+
+string formatCents(long long cents)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "$%lld.%02lld", cents / 100, cents % 100);
+    return buffer;
+}
+
+#ifdef _WIN32
+int openForWriting(const string &path, bool append)
+{
+    int flags = _O_WRONLY | _O_CREAT | _O_BINARY | (append ? _O_APPEND : _O_TRUNC);
+    return _open(path.c_str(), flags, _S_IREAD | _S_IWRITE);
+}
+
+bool writeAll(int fd, string_view data)
+{
+    while (!data.empty())
     {
-        peopleFile << "\"ID\", \"Name\", \"Role\", \"Books Borrowed\", \"Time Borrowed\", \"Due Date\", \"Late Fees\"\n";
-        peopleFile << "\"1\", \"Dr. Emily Carter\", \"Faculty\", \"None\", \"N/A\", \"N/A\", \"$0\"\n";
-        peopleFile << "\"2\", \"Prof. Robert Greene\", \"Faculty\", \"None\", \"N/A\", \"N/A\", \"$0\"\n";
-        peopleFile.close();
+        int written = _write(fd, data.data(), static_cast<unsigned>(data.size()));
+        if (written <= 0)
+            return false;
+        data.remove_prefix(written);
     }
+    return true;
+}
+
+bool syncFile(int fd)
+{
+    return _commit(fd) == 0;
+}
+
+bool truncateFile(int fd, uint64_t length)
+{
+    return _chsize_s(fd, static_cast<__int64>(length)) == 0;
+}
+
+void closeFile(int fd)
+{
+    _close(fd);
+}
 
-    ofstream usersFile("users.txt");
-    if (usersFile.is_open())
+bool replaceFile(const string &from, const string &to)
+{
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+}
+
+const char *mapFile(const string &path, size_t &length)
+{
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+    const char *data = nullptr;
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
     {
-        usersFile << "1, \"admin\", \"ADMIN\", \"admin123\"\n";
-        usersFile << "2, \"faculty1\", \"FACULTY\", \"faculty123\"\n";
-        usersFile << "3, \"student1\", \"STUDENT\", \"student123\"\n";
-        usersFile.close();
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping)
+        {
+            data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            CloseHandle(mapping);
+        }
+        length = static_cast<size_t>(size.QuadPart);
     }
+    CloseHandle(file);
+    return data;
 }
 
-void Library::signup()
+void unmapFile(const char *data, size_t)
 {
-    string username, password;
+    UnmapViewOfFile(data);
+}
 
-    cout << "Create your Username: ";
-    cin.ignore();
-    getline(cin, username);
-    username = cleanString(username);
+int openForLocking(const string &path)
+{
+    return _open(path.c_str(), _O_RDWR | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+}
 
-    cout << "Enter your password: ";
-    getline(cin, password);
-    password = cleanString(password);
+// Windows locks are mandatory, so the locked range starts past the end of
+// the data and leaves the file's contents readable.
+bool lockFile(int fd, bool exclusive)
+{
+    OVERLAPPED range = {};
+    range.OffsetHigh = 1;
+    HANDLE file = reinterpret_cast<HANDLE>(_get_osfhandle(fd));
+    return LockFileEx(file, exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, 1, 0, &range) != 0;
+}
+
+void unlockFile(int fd)
+{
+    OVERLAPPED range = {};
+    range.OffsetHigh = 1;
+    UnlockFileEx(reinterpret_cast<HANDLE>(_get_osfhandle(fd)), 0, 1, 0, &range);
+}
 
-    ofstream usersFile("users.txt", ios::app);
-    ofstream peopleFile("People.txt", ios::app);
+bool readAt(int fd, char *buffer, size_t size, uint64_t offset)
+{
+    return _lseeki64(fd, offset, SEEK_SET) >= 0 && _read(fd, buffer, static_cast<unsigned>(size)) == static_cast<int>(size);
+}
+
+bool writeAt(int fd, string_view data, uint64_t offset)
+{
+    return _lseeki64(fd, offset, SEEK_SET) >= 0 && writeAll(fd, data);
+}
+#else
+int openForWriting(const string &path, bool append)
+{
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+    return open(path.c_str(), flags, 0644);
+}
 
-    if (!usersFile.is_open() || !peopleFile.is_open())
+bool writeAll(int fd, string_view data)
+{
+    while (!data.empty())
     {
-        cerr << "Error: Could not open user files!\n";
-        return;
+        ssize_t written = write(fd, data.data(), data.size());
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data.remove_prefix(written);
     }
+    return true;
+}
 
-    usersFile << next_id << ", \"" << username << "\", \"STUDENT\", \"" << password << "\"\n";
+bool syncFile(int fd)
+{
+    return fdatasync(fd) == 0;
+}
 
-    peopleFile << "\"" << next_id << "\", \"" << username << "\", \"Student\", \"None\", \"N/A\", \"N/A\", \"$0\"\n";
+bool truncateFile(int fd, uint64_t length)
+{
+    return ftruncate(fd, static_cast<off_t>(length)) == 0;
+}
 
-    current_user_id = next_id;
-    current_username = username;
-    current_password = password;
-    current_role = STUDENT;
-    is_logged_in = true;
+void closeFile(int fd)
+{
+    close(fd);
+}
 
-    cout << "\nAccount created successfully!\n";
-    cout << "Your ID is " << next_id << "\n";
-    next_id++;
+// rename() is atomic on POSIX, but the new directory entry is only durable
+// once the directory itself has been synced.
+bool replaceFile(const string &from, const string &to)
+{
+    if (rename(from.c_str(), to.c_str()) != 0)
+        return false;
 
-    usersFile.close();
-    peopleFile.close();
-    showUserMenu();
+    size_t slash = to.find_last_of('/');
+    string dir = (slash == string::npos) ? "." : to.substr(0, slash + 1);
+    int dirFd = open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+    if (dirFd >= 0)
+    {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    return true;
 }
 
-void Library::login()
+int openForLocking(const string &path)
 {
-    string username, password;
-    cout << "Enter your username: ";
-    cin >> username;
-    cout << "Enter your password: ";
-    cin >> password;
+    return open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+}
 
-    ifstream usersFile("users.txt");
-    if (!usersFile.is_open())
+// flock locks belong to the open file description, so every thread of a
+// process shares one lock; DataLock does the per-thread bookkeeping.
+bool lockFile(int fd, bool exclusive)
+{
+    while (flock(fd, exclusive ? LOCK_EX : LOCK_SH) != 0)
     {
-        cerr << "Error: Could not open users file!\n";
-        return;
+        if (errno != EINTR)
+            return false;
     }
+    return true;
+}
 
-    string line;
-    while (getline(usersFile, line))
-    {
-        vector<string> parts;
-        stringstream ss(line);
-        string part;
+void unlockFile(int fd)
+{
+    flock(fd, LOCK_UN);
+}
+
+bool readAt(int fd, char *buffer, size_t size, uint64_t offset)
+{
+    return pread(fd, buffer, size, offset) == static_cast<ssize_t>(size);
+}
+
+bool writeAt(int fd, string_view data, uint64_t offset)
+{
+    return pwrite(fd, data.data(), data.size(), offset) == static_cast<ssize_t>(data.size());
+}
+
+// Maps a whole file read-only. Pages are only read from disk once touched.
+const char *mapFile(const string &path, size_t &length)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return nullptr;
 
-        while (getline(ss, part, ','))
+    const char *data = nullptr;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED)
         {
-            parts.push_back(cleanString(part));
+            data = static_cast<const char *>(mapped);
+            length = static_cast<size_t>(info.st_size);
         }
+    }
+    close(fd);
+    return data;
+}
 
-        if (parts.size() >= 4)
-        {
-            string file_username = parts[1];
-            string file_password = parts[3];
+void unmapFile(const char *data, size_t length)
+{
+    munmap(const_cast<char *>(data), length);
+}
+#endif
 
-            if (file_username == username && file_password == password)
-            {
-                current_user_id = stoi(parts[0]);
-                current_username = username;
-                current_password = password;
-
-                string role_str = parts[2];
-                if (role_str == "ADMIN")
-                    current_role = ADMIN;
-                else if (role_str == "FACULTY")
-                    current_role = FACULTY;
-                else
-                    current_role = STUDENT;
-
-                is_logged_in = true;
-                cout << "\nLogin successful! Welcome " << username << "!\n";
-                usersFile.close();
-                showUserMenu();
-                return;
-            }
-        }
+// Writes a snapshot under a temporary name and renames it over the target
+// only after the data has been synced, so a crash or a full disk leaves
+// either the complete old file or the complete new one.
+class AtomicFileWriter
+{
+private:
+    string path;
+    string tempPath;
+    string buffer;
+    int fd;
+    bool failed;
+
+    void flushBuffer();
+
+public:
+    explicit AtomicFileWriter(const string &target);
+    ~AtomicFileWriter();
+
+    bool isOpen() const;
+    void write(string_view data);
+    bool commit();
+};
+
+AtomicFileWriter::AtomicFileWriter(const string &target)
+{
+    path = target;
+    tempPath = target + ".tmp";
+    fd = openForWriting(tempPath, false);
+    failed = fd < 0;
+}
+
+AtomicFileWriter::~AtomicFileWriter()
+{
+    if (fd >= 0)
+    {
+        closeFile(fd);
+        remove(tempPath.c_str());
     }
+}
 
-    usersFile.close();
-    cerr << "Invalid username or password!\n";
+bool AtomicFileWriter::isOpen() const
+{
+    return fd >= 0;
 }
 
-void Library::logout()
+void AtomicFileWriter::flushBuffer()
 {
-    cout << " Logging out...." << endl;
-    cout << " You have successfully logged out!!" << endl;
-    cout << "**********Goodbye**********" << endl;
+    if (!failed && !writeAll(fd, buffer))
+        failed = true;
+    buffer.clear();
+}
 
-    current_user_id = 0;
-    current_username = "";
-    current_password = "";
-    is_logged_in = false;
-    cin.ignore(numeric_limits<streamsize>::max(), '\n');
-    this_thread::sleep_for(chrono::seconds(1));
+void AtomicFileWriter::write(string_view data)
+{
+    const size_t flushThreshold = 1 << 16;
+
+    buffer.append(data);
+    if (buffer.size() >= flushThreshold)
+        flushBuffer();
 }
 
-void Library::displayBooks(bool returnToMenu)
+bool AtomicFileWriter::commit()
 {
-    ifstream booksFile("books.txt");
-    if (!booksFile.is_open())
+    if (fd < 0)
+        return false;
+
+    flushBuffer();
+    if (!failed && !syncFile(fd))
+        failed = true;
+    closeFile(fd);
+    fd = -1;
+
+    if (failed || !replaceFile(tempPath, path))
     {
-        cerr << "Error: Could not open books file!" << endl;
-        return;
+        remove(tempPath.c_str());
+        return false;
     }
+    return true;
+}
 
-    cout << "\n=========== Library Book Collection ===========\n\n";
+struct LoadStats
+{
+    size_t bytes = 0;
+    double seconds = 0;
+    unsigned threads = 0;
+};
 
-    string line;
+// Parses every line of a CSV file on all cores. The mapped file is cut into
+// one chunk per thread, each moved forward to the next line start; no field
+// in these files spans lines, so a line boundary is always a record boundary.
+// Each thread fills its own row buffer, and the buffers are handed to merge
+// in file order, so duplicates resolve exactly as a sequential read would.
+// A first line whose first field is exactly firstColumn is the header and is
+// skipped; any other first line is a record. Returns false only if the file
+// could not be opened.
+template <typename Row, typename Parse, typename Merge>
+bool loadLinesParallel(const string &path, string_view firstColumn, Parse parse, Merge merge, LoadStats &stats)
+{
+    const size_t minChunkBytes = 1 << 20;
+    auto started = chrono::steady_clock::now();
+
+    size_t length = 0;
+    const char *data = mapFile(path, length);
+    if (!data)
+    {
+        ifstream probe(path);
+        stats = LoadStats();
+        return probe.is_open();
+    }
 
-    getline(booksFile, line);
-    if (line.find("ID") == string::npos)
+    string_view text(data, length);
+    size_t begin = 0;
+    size_t headerEnd = text.find('\n');
+    string_view header[1];
+    splitRecord(text.substr(0, headerEnd), header, 1);
+    if (header[0] == firstColumn)
     {
-        booksFile.clear();
-        booksFile.seekg(0);
+        begin = (headerEnd == string_view::npos) ? length : headerEnd + 1;
     }
 
-    int count = 0;
-    while (getline(booksFile, line))
+    size_t cores = max(1u, thread::hardware_concurrency());
+    size_t threads = max<size_t>(1, min(cores, (length - begin) / minChunkBytes));
+    vector<size_t> bounds(threads + 1, length);
+    bounds[0] = begin;
+    for (size_t t = 1; t < threads; t++)
     {
-        vector<string> parts;
-        string current;
-        bool inQuotes = false;
+        size_t newline = text.find('\n', max(bounds[t - 1], begin + (length - begin) / threads * t));
+        bounds[t] = (newline == string_view::npos) ? length : newline + 1;
+    }
 
-        for (char c : line)
+    vector<vector<Row>> rows(threads);
+    vector<vector<string_view>> rejected(threads);
+    auto parseChunk = [&](size_t t)
+    {
+        size_t pos = bounds[t];
+        while (pos < bounds[t + 1])
         {
-            if (c == '\"')
-            {
-                inQuotes = !inQuotes;
-            }
-            else if (c == ',' && !inQuotes)
-            {
-                parts.push_back(cleanString(current));
-                current.clear();
-            }
+            size_t end = text.find('\n', pos);
+            if (end == string_view::npos)
+                end = length;
+            string_view line = text.substr(pos, end - pos);
+            pos = end + 1;
+
+            if (trimField(line).empty())
+                continue;
+            Row row;
+            if (parse(line, row))
+                rows[t].push_back(move(row));
             else
-            {
-                current += c;
-            }
+                rejected[t].push_back(line);
         }
-        parts.push_back(cleanString(current));
+    };
 
-        if (parts.size() >= 5)
-        {
-            count++;
-            cout << "---------------------------------------------\n";
-            cout << " Book #" << count << "\n";
-            cout << "---------------------------------------------\n";
-            cout << " ID:              " << parts[0] << "\n";
-            cout << " Title:           " << parts[1] << "\n";
-            cout << " Author:          " << parts[2] << "\n";
-            cout << " Year Published:  " << parts[3] << "\n";
-            cout << " Available Copies:" << parts[4] << "\n\n";
-        }
-        else
-        {
-            cerr << "Warning: Invalid book record format - " << line << endl;
-        }
+    vector<thread> workers;
+    for (size_t t = 1; t < threads; t++)
+    {
+        workers.emplace_back(parseChunk, t);
+    }
+    parseChunk(0);
+    for (auto &worker : workers)
+    {
+        worker.join();
     }
 
-    booksFile.close();
-
-    if (count == 0)
+    for (size_t t = 0; t < threads; t++)
     {
-        cout << "No books found in the library.\n";
+        merge(rows[t], rejected[t]);
     }
+    unmapFile(data, length);
 
-    cout << "=============================================\n";
+    stats.bytes = length;
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    stats.threads = static_cast<unsigned>(threads);
+    return true;
+}
 
-    if (current_role == ADMIN)
-    {
-        int choice;
-        cout << "\n****** What would you like to do? ******\n";
-        cout << "1. Edit a book\n";
-        cout << "2. Remove a book\n";
-        cout << "3. Add a new book\n";
-        cout << "4. Return to main menu\n";
-        cout << "Enter your choice (1-4): ";
-        cin >> choice;
+struct Book
+{
+    int id;
+    string title;
+    string author;
+    int year;
+    int copies;
+};
 
-        switch (choice)
-        {
-        case 1:
-            editBook();
-            break;
-        case 2:
-            removeBook();
-            break;
-        case 3:
-            addBook();
-            break;
-        case 4:
-            showUserMenu();
-            break;
-        default:
-            cerr << "Invalid choice. Returning to menu." << endl;
-            showUserMenu();
-        }
+bool parseBook(const string_view *fields, size_t count, Book &book)
+{
+    if (count < 5)
+    {
+        return false;
     }
-    else if (returnToMenu)
+
+    if (!parseInt(fields[0], book.id) || !parseInt(fields[3], book.year) || !parseInt(fields[4], book.copies))
     {
-        cout << "Press Enter to continue...";
-        cin.ignore();
-        cin.get();
-        showUserMenu();
+        return false;
     }
+    book.title.assign(fields[1]);
+    book.author.assign(fields[2]);
+    return true;
 }
 
-void Library::searchBooks()
+string formatBook(const Book &book, int copies)
 {
-    string searchTitle;
-    cout << "Enter book title to search: ";
-    cin.ignore();
-    getline(cin, searchTitle);
-
-    ifstream booksFile("books.txt");
-    if (!booksFile.is_open())
-    {
-        cerr << "Error: Could not open books file!" << endl;
-        return;
-    }
+    return to_string(book.id) + ", \"" + book.title + "\", \"" + book.author + "\", " +
+           to_string(book.year) + ", " + to_string(copies);
+}
 
-    cout << "\n=== Search Results ===\n";
-    string line;
-    bool found = false;
+string formatBook(const Book &book)
+{
+    return formatBook(book, book.copies);
+}
 
-    while (getline(booksFile, line))
+// Splits text into lowercase word tokens. Letters and digits form words;
+// bytes outside ASCII are kept so accented UTF-8 words stay in one piece.
+template <typename Visitor>
+void forEachToken(string_view text, Visitor visit)
+{
+    string token;
+    for (size_t i = 0; i <= text.size(); i++)
     {
-        stringstream ss(line);
-        string part;
-        vector<string> parts;
-
-        while (getline(ss, part, ','))
+        unsigned char c = (i < text.size()) ? static_cast<unsigned char>(text[i]) : ' ';
+        if (isalnum(c) || c >= 0x80)
         {
-            parts.push_back(cleanString(part));
+            token += static_cast<char>(tolower(c));
         }
-
-        if (parts.size() >= 5)
+        else if (!token.empty())
         {
-            string title = parts[1];
-            string titleLower = title;
-            transform(titleLower.begin(), titleLower.end(), titleLower.begin(), ::tolower);
-
-            string searchLower = searchTitle;
-            transform(searchLower.begin(), searchLower.end(), searchLower.begin(), ::tolower);
-
-            if (titleLower.find(searchLower) != string::npos)
-            {
-                cout << "ID: " << parts[0] << endl;
-                cout << "Title: " << title << endl;
-                cout << "Author: " << parts[2] << endl;
-                cout << "Year: " << parts[3] << endl;
-                cout << "Available Copies: " << parts[4] << endl;
-                cout << "--------------------------------" << endl;
-                found = true;
-            }
+            visit(token);
+            token.clear();
         }
     }
-
-    booksFile.close();
-
-    if (!found)
-    {
-        cout << "No matching books found." << endl;
-    }
-
-    cout << "Press Enter to continue...";
-    cin.get();
-    showUserMenu();
 }
 
-void Library::addBook()
+// Inverted index over book titles and authors. Each token maps to a posting
+// list sorted by book ID that records how often the token occurs in the
+// title and in the author of that book. An index is filled once and then
+// only read; a catalog keeps later changes beside it until they are merged
+// into a new one.
+class SearchIndex
 {
-    if (current_role != ADMIN)
+public:
+    struct Posting
     {
-        cerr << "Error: You don't have permission to add books." << endl;
-        return;
-    }
-
-    ifstream inFile("books.txt");
-    string line;
-    getline(inFile, line);
-    int maxId = 0;
+        int bookId;
+        uint16_t titleHits;
+        uint16_t authorHits;
+    };
 
-    while (getline(inFile, line))
-    {
-        stringstream ss(line);
-        string idStr;
-        getline(ss, idStr, ',');
-        int id = stoi(cleanString(idStr));
-        if (id > maxId)
-            maxId = id;
-    }
-    inFile.close();
+    // One book's tokens with their counts, sorted by token.
+    using Terms = vector<pair<string, Posting>>;
 
-    int newId = maxId + 1;
-    string title, author;
-    int year, stock;
+private:
+    unordered_map<string, vector<Posting>> postings;
 
-    cout << "Adding new book with ID " << newId << endl;
-    cout << "Enter the title of the book: ";
-    cin.ignore();
-    getline(cin, title);
-    cout << "Enter the author of the book: ";
-    getline(cin, author);
-    cout << "Enter the year of publication: ";
-    cin >> year;
-    cout << "Enter the number of copies available: ";
-    cin >> stock;
+public:
+    static Terms countTokens(int bookId, string_view title, string_view author);
+    void add(int bookId, string_view title, string_view author);
+    void add(const Terms &terms);
+    template <typename Keep>
+    void merge(const SearchIndex &older, Keep keep, const SearchIndex &newer);
+    const vector<Posting> *find(const string &token) const;
+    template <typename Skip>
+    vector<pair<double, int>> rank(const vector<string> &tokens, const vector<double> &weights, Skip skip) const;
+};
 
-    ofstream outFile("books.txt", ios::app);
-    if (outFile.is_open())
+SearchIndex::Terms SearchIndex::countTokens(int bookId, string_view title, string_view author)
+{
+    map<string, Posting> counts;
+    forEachToken(title, [&](const string &token)
     {
-        outFile << newId << ", \"" << title << "\", \"" << author << "\", " << year << ", " << stock << "\n";
-        outFile.close();
-        cout << "Book successfully added to the library!" << endl;
-    }
-    else
+        Posting &posting = counts.emplace(token, Posting{bookId, 0, 0}).first->second;
+        posting.titleHits++;
+    });
+    forEachToken(author, [&](const string &token)
     {
-        cerr << "Error: Could not open books file for writing!" << endl;
-    }
+        Posting &posting = counts.emplace(token, Posting{bookId, 0, 0}).first->second;
+        posting.authorHits++;
+    });
+    return Terms(counts.begin(), counts.end());
+}
 
-    cout << "Press Enter to continue...";
-    cin.ignore();
-    cin.get();
-    showUserMenu();
+void SearchIndex::add(int bookId, string_view title, string_view author)
+{
+    add(countTokens(bookId, title, author));
 }
 
-void Library::editBook()
+// Adds one book from its counted tokens.
+void SearchIndex::add(const Terms &terms)
 {
-    if (current_role != ADMIN)
+    for (const auto &entry : terms)
     {
-        cerr << "Error: You don't have permission to edit books." << endl;
-        return;
-    }
+        int bookId = entry.second.bookId;
+        vector<Posting> &list = postings[entry.first];
+        if (list.empty() || list.back().bookId < bookId)
+        {
+            list.push_back(entry.second);
+            continue;
+        }
 
-    ifstream inFile("books.txt");
-    if (!inFile.is_open())
-    {
-        cerr << "Error: Could not open books file!" << endl;
-        return;
+        auto pos = lower_bound(list.begin(), list.end(), bookId, [](const Posting &posting, int id)
+        {
+            return posting.bookId < id;
+        });
+        list.insert(pos, entry.second);
     }
+}
 
-    vector<vector<string>> books;
-    string line;
-
-    getline(inFile, line);
-
-    while (getline(inFile, line))
+// Fills this index with the postings of older that keep accepts plus all of
+// newer's, merging list by list, so no book is tokenized again.
+template <typename Keep>
+void SearchIndex::merge(const SearchIndex &older, Keep keep, const SearchIndex &newer)
+{
+    auto byId = [](const Posting &a, const Posting &b)
     {
-        vector<string> parts;
-        string current;
-        bool inQuotes = false;
+        return a.bookId < b.bookId;
+    };
 
-        for (char c : line)
+    postings.clear();
+    postings.reserve(older.postings.size());
+    for (const auto &entry : older.postings)
+    {
+        vector<Posting> list;
+        list.reserve(entry.second.size());
+        copy_if(entry.second.begin(), entry.second.end(), back_inserter(list), [&](const Posting &posting)
         {
-            if (c == '\"')
-            {
-                inQuotes = !inQuotes;
-            }
-            else if (c == ',' && !inQuotes)
-            {
-                parts.push_back(cleanString(current));
-                current.clear();
-            }
-            else
-            {
-                current += c;
-            }
-        }
-        parts.push_back(cleanString(current));
+            return keep(posting.bookId);
+        });
 
-        if (parts.size() >= 5)
+        auto added = newer.postings.find(entry.first);
+        if (added != newer.postings.end())
         {
-            books.push_back(parts);
+            size_t middle = list.size();
+            list.insert(list.end(), added->second.begin(), added->second.end());
+            inplace_merge(list.begin(), list.begin() + middle, list.end(), byId);
         }
+        if (!list.empty())
+            postings.emplace(entry.first, move(list));
+    }
+    for (const auto &entry : newer.postings)
+    {
+        postings.emplace(entry.first, entry.second);
     }
-    inFile.close();
+}
 
-    cout << "\n=========== Library Book Collection ===========\n\n";
-    for (size_t i = 0; i < books.size(); i++)
+// The posting list of token, or null if no book contains it.
+const vector<SearchIndex::Posting> *SearchIndex::find(const string &token) const
+{
+    auto found = postings.find(token);
+    return (found == postings.end()) ? nullptr : &found->second;
+}
+
+// Scores the books that contain every token in their title or author, as
+// (-score, book ID) pairs so that sorting puts the best match first. A token
+// scores its title hits twice as high as its author hits, times its weight.
+// Books for which skip returns true are left out.
+template <typename Skip>
+vector<pair<double, int>> SearchIndex::rank(const vector<string> &tokens, const vector<double> &weights,
+                                            Skip skip) const
+{
+    // The shortest list drives the intersection, but each book's score is
+    // summed in token order, as Catalog::search does for changed books, so
+    // equal scores compare equal wherever the book is stored.
+    vector<const vector<Posting> *> lists;
+    for (const string &token : tokens)
     {
-        cout << "---------------------------------------------\n";
-        cout << " Book #" << i + 1 << "\n";
-        cout << "---------------------------------------------\n";
-        cout << " ID:              " << books[i][0] << "\n";
-        cout << " Title:           " << books[i][1] << "\n";
-        cout << " Author:          " << books[i][2] << "\n";
-        cout << " Year Published:  " << books[i][3] << "\n";
-        cout << " Available Copies:" << books[i][4] << "\n\n";
+        lists.push_back(find(token));
+        if (!lists.back())
+            return {};
+    }
+    if (lists.empty())
+    {
+        return {};
     }
-    cout << "=============================================\n";
 
-    int bookId;
-    cout << "Enter the ID of the book you want to edit: ";
-    cin >> bookId;
-    cin.ignore();
+    vector<size_t> order(lists.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    sort(order.begin(), order.end(), [&](size_t a, size_t b)
+    {
+        return lists[a]->size() < lists[b]->size();
+    });
 
-    bool found = false;
-    for (auto &book : books)
-    {
-        if (stoi(book[0]) == bookId)
-        {
-            found = true;
-            cout << "\nCurrent Book details:\n";
-            cout << "ID: " << book[0] << endl;
-            cout << "Title: " << book[1] << endl;
-            cout << "Author: " << book[2] << endl;
-            cout << "Year: " << book[3] << endl;
-            cout << "Stock: " << book[4] << endl;
-
-            int choice;
-            cout << "\nWhich field would you like to edit?\n";
-            cout << "1. Title\n";
-            cout << "2. Author\n";
-            cout << "3. Year\n";
-            cout << "4. Stock\n";
-            cout << "Enter your choice: ";
-            cin >> choice;
-            cin.ignore();
+    vector<pair<double, int>> ranked;
+    vector<size_t> cursor(lists.size(), 0);
+    vector<const Posting *> hits(lists.size());
+    for (const Posting &candidate : *lists[order[0]])
+    {
+        bool inAll = true;
+        for (size_t i : order)
+        {
+            const vector<Posting> &list = *lists[i];
+            size_t &pos = cursor[i];
+            while (pos < list.size() && list[pos].bookId < candidate.bookId)
+                pos++;
 
-            switch (choice)
+            if (pos == list.size() || list[pos].bookId != candidate.bookId)
             {
-            case 1:
-                cout << "Enter the new title: ";
-                getline(cin, book[1]);
-                break;
-            case 2:
-                cout << "Enter the new author: ";
-                getline(cin, book[2]);
-                break;
-            case 3:
-                cout << "Enter the new year: ";
-                cin >> book[3];
-                break;
-            case 4:
-                cout << "Enter the new stock: ";
-                cin >> book[4];
+                inAll = false;
                 break;
-            default:
-                cerr << "Invalid choice. No changes made." << endl;
-                showUserMenu();
-                return;
             }
+            hits[i] = &list[pos];
+        }
+        if (!inAll || skip(candidate.bookId))
+            continue;
 
-            cout << "\nBook details successfully updated!\n";
-            break;
+        double score = 0;
+        for (size_t i = 0; i < hits.size(); i++)
+        {
+            score += (2.0 * hits[i]->titleHits + hits[i]->authorHits) * weights[i];
         }
+        ranked.push_back({-score, candidate.bookId});
     }
+    return ranked;
+}
 
-    if (!found)
-    {
-        cerr << "Book with ID " << bookId << " not found.\n";
-        showUserMenu();
-        return;
-    }
+// True when text contains the already lowercased pattern, ignoring ASCII
+// case in text. Works in place so callers never copy the text.
+bool containsIgnoreCase(string_view text, string_view lowerPattern)
+{
+    if (lowerPattern.empty())
+        return true;
+    if (lowerPattern.size() > text.size())
+        return false;
 
-    ofstream outFile("books.txt");
-    if (!outFile.is_open())
+    for (size_t start = 0; start + lowerPattern.size() <= text.size(); start++)
     {
-        cerr << "Error: Could not open books file for writing!" << endl;
-        showUserMenu();
-        return;
+        size_t i = 0;
+        while (i < lowerPattern.size() &&
+               tolower(static_cast<unsigned char>(text[start + i])) == static_cast<unsigned char>(lowerPattern[i]))
+            i++;
+        if (i == lowerPattern.size())
+            return true;
     }
+    return false;
+}
+
+// Case-insensitive substring scan over a large contiguous buffer, used when
+// no index can narrow the search. Each kernel returns the offset of the first
+// match at or after from, or string_view::npos. The pattern must already be
+// lowercase; only ASCII letters in the text are folded, matching ::tolower.
+size_t findIgnoreCaseScalar(string_view text, string_view lowerPattern, size_t from)
+{
+    size_t m = lowerPattern.size();
+    if (m == 0)
+        return from <= text.size() ? from : string_view::npos;
 
-    outFile << "ID,Title,Author,Year,Copies\n";
-    for (const auto &book : books)
+    for (size_t i = from; i + m <= text.size(); i++)
     {
-        outFile << book[0] << ", \"" << book[1] << "\", \"" << book[2] << "\", "
-                << book[3] << ", " << book[4] << "\n";
+        size_t j = 0;
+        while (j < m && tolower(static_cast<unsigned char>(text[i + j])) == static_cast<unsigned char>(lowerPattern[j]))
+            j++;
+        if (j == m)
+            return i;
     }
-    outFile.close();
-
-    cout << "Press Enter to continue...";
-    cin.ignore();
-    cin.get();
-    showUserMenu();
+    return string_view::npos;
 }
 
-void Library::removeBook()
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LIBRARY_SIMD_SCAN 1
+#include <immintrin.h>
+
+__attribute__((target("sse2"))) inline __m128i foldAsciiSse2(__m128i bytes)
 {
-    if (current_role != ADMIN)
-    {
-        cerr << "Error: You don't have permission to remove books." << endl;
-        return;
-    }
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(bytes, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(bytes, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
 
-    ifstream inFile("books.txt");
-    if (!inFile.is_open())
-    {
-        cerr << "Error: Could not open books file!" << endl;
-        return;
-    }
+__attribute__((target("avx2"))) inline __m256i foldAsciiAvx2(__m256i bytes)
+{
+    __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), bytes));
+    return _mm256_or_si256(bytes, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
 
-    vector<vector<string>> books;
-    string line;
+// Compares the first and last pattern byte against 16 (or 32) candidate
+// positions at once and only verifies the middle of the pattern where both
+// ends already match. Uppercase ASCII is folded in-register by OR-ing 0x20
+// into bytes between 'A' and 'Z'; bytes >= 0x80 compare as negative and are
+// never folded.
+__attribute__((target("sse2"))) size_t findIgnoreCaseSse2(string_view text, string_view lowerPattern, size_t from)
+{
+    size_t m = lowerPattern.size();
+    if (m == 0)
+        return findIgnoreCaseScalar(text, lowerPattern, from);
 
-    getline(inFile, line);
+    const char *data = text.data();
+    const __m128i first = _mm_set1_epi8(lowerPattern[0]);
+    const __m128i last = _mm_set1_epi8(lowerPattern[m - 1]);
 
-    while (getline(inFile, line))
+    size_t i = from;
+    for (; i + m - 1 + 16 <= text.size(); i += 16)
     {
-        vector<string> parts;
-        string current;
-        bool inQuotes = false;
+        __m128i head = foldAsciiSse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)));
+        __m128i tail = foldAsciiSse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + m - 1)));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last)));
 
-        for (char c : line)
+        while (mask != 0)
         {
-            if (c == '\"')
-            {
-                inQuotes = !inQuotes;
-            }
-            else if (c == ',' && !inQuotes)
-            {
-                parts.push_back(cleanString(current));
-                current.clear();
-            }
-            else
-            {
-                current += c;
-            }
+            size_t candidate = i + __builtin_ctz(mask);
+            size_t j = 1;
+            while (j < m - 1 && tolower(static_cast<unsigned char>(data[candidate + j])) == static_cast<unsigned char>(lowerPattern[j]))
+                j++;
+            if (j >= m - 1)
+                return candidate;
+            mask &= mask - 1;
         }
-        parts.push_back(cleanString(current));
+    }
+    return findIgnoreCaseScalar(text, lowerPattern, i);
+}
+
+__attribute__((target("avx2"))) size_t findIgnoreCaseAvx2(string_view text, string_view lowerPattern, size_t from)
+{
+    size_t m = lowerPattern.size();
+    if (m == 0)
+        return findIgnoreCaseScalar(text, lowerPattern, from);
 
-        if (parts.size() >= 5)
+    const char *data = text.data();
+    const __m256i first = _mm256_set1_epi8(lowerPattern[0]);
+    const __m256i last = _mm256_set1_epi8(lowerPattern[m - 1]);
+
+    size_t i = from;
+    for (; i + m - 1 + 32 <= text.size(); i += 32)
+    {
+        __m256i head = foldAsciiAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)));
+        __m256i tail = foldAsciiAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + m - 1)));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(tail, last)));
+
+        while (mask != 0)
         {
-            books.push_back(parts);
+            size_t candidate = i + __builtin_ctz(mask);
+            size_t j = 1;
+            while (j < m - 1 && tolower(static_cast<unsigned char>(data[candidate + j])) == static_cast<unsigned char>(lowerPattern[j]))
+                j++;
+            if (j >= m - 1)
+                return candidate;
+            mask &= mask - 1;
         }
     }
-    inFile.close();
+    return findIgnoreCaseSse2(text, lowerPattern, i);
+}
+#endif
 
-    cout << "\n=========== Library Book Collection ===========\n\n";
-    for (size_t i = 0; i < books.size(); i++)
+using FindIgnoreCaseKernel = size_t (*)(string_view, string_view, size_t);
+
+FindIgnoreCaseKernel selectFindIgnoreCaseKernel()
+{
+#ifdef LIBRARY_SIMD_SCAN
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return findIgnoreCaseAvx2;
+    if (__builtin_cpu_supports("sse2"))
+        return findIgnoreCaseSse2;
+#endif
+    return findIgnoreCaseScalar;
+}
+
+// Picks the widest kernel the CPU supports the first time it is called.
+size_t findIgnoreCase(string_view text, string_view lowerPattern, size_t from)
+{
+    static const FindIgnoreCaseKernel kernel = selectFindIgnoreCaseKernel();
+    return kernel(text, lowerPattern, from);
+}
+
+// Maps every case-folded three-byte sequence of a title to the sorted IDs of
+// the books whose titles contain it. Any substring of three or more bytes
+// can only occur in titles that contain all of its trigrams, which narrows a
+// substring query to a handful of candidates before they are verified.
+class TrigramIndex
+{
+private:
+    unordered_map<uint32_t, vector<int>> postings;
+
+    static vector<uint32_t> trigrams(string_view text);
+
+public:
+    void add(int bookId, string_view title);
+    template <typename Keep>
+    void merge(const TrigramIndex &older, Keep keep, const TrigramIndex &newer);
+    vector<int> candidates(string_view lowerPattern) const;
+};
+
+vector<uint32_t> TrigramIndex::trigrams(string_view text)
+{
+    vector<uint32_t> grams;
+    for (size_t i = 0; i + 3 <= text.size(); i++)
     {
-        cout << "---------------------------------------------\n";
-        cout << " Book #" << i + 1 << "\n";
-        cout << "---------------------------------------------\n";
-        cout << " ID:              " << books[i][0] << "\n";
-        cout << " Title:           " << books[i][1] << "\n";
-        cout << " Author:          " << books[i][2] << "\n";
-        cout << " Year Published:  " << books[i][3] << "\n";
-        cout << " Available Copies:" << books[i][4] << "\n\n";
+        uint32_t gram = 0;
+        for (size_t j = 0; j < 3; j++)
+            gram = (gram << 8) | static_cast<unsigned char>(tolower(static_cast<unsigned char>(text[i + j])));
+        grams.push_back(gram);
     }
-    cout << "=============================================\n";
+    sort(grams.begin(), grams.end());
+    grams.erase(unique(grams.begin(), grams.end()), grams.end());
+    return grams;
+}
 
-    int bookId;
-    cout << "Enter the ID of the book you want to remove: ";
-    cin >> bookId;
-    cin.ignore();
+void TrigramIndex::add(int bookId, string_view title)
+{
+    for (uint32_t gram : trigrams(title))
+    {
+        vector<int> &list = postings[gram];
+        if (list.empty() || list.back() < bookId)
+            list.push_back(bookId);
+        else
+            list.insert(lower_bound(list.begin(), list.end(), bookId), bookId);
+    }
+}
 
-    bool found = false;
-    for (auto it = books.begin(); it != books.end(); ++it)
+// Same as SearchIndex::merge.
+template <typename Keep>
+void TrigramIndex::merge(const TrigramIndex &older, Keep keep, const TrigramIndex &newer)
+{
+    postings.clear();
+    postings.reserve(older.postings.size());
+    for (const auto &entry : older.postings)
     {
-        if (stoi((*it)[0]) == bookId)
+        vector<int> list;
+        list.reserve(entry.second.size());
+        copy_if(entry.second.begin(), entry.second.end(), back_inserter(list), keep);
+
+        auto added = newer.postings.find(entry.first);
+        if (added != newer.postings.end())
         {
-            found = true;
-            string bookTitle = (*it)[1];
-            books.erase(it);
-            cout << "\nBook \"" << bookTitle << "\" (ID: " << bookId << ") removed successfully!\n";
-            break;
+            size_t middle = list.size();
+            list.insert(list.end(), added->second.begin(), added->second.end());
+            inplace_merge(list.begin(), list.begin() + middle, list.end());
         }
+        if (!list.empty())
+            postings.emplace(entry.first, move(list));
     }
-
-    if (!found)
+    for (const auto &entry : newer.postings)
     {
-        cerr << "Book with ID " << bookId << " not found.\n";
-        showUserMenu();
-        return;
+        postings.emplace(entry.first, entry.second);
     }
+}
 
-    ofstream outFile("books.txt");
-    if (!outFile.is_open())
+// Returns the sorted IDs of books whose titles contain every trigram of the
+// pattern. The pattern must be at least three bytes long.
+vector<int> TrigramIndex::candidates(string_view lowerPattern) const
+{
+    vector<const vector<int> *> lists;
+    for (uint32_t gram : trigrams(lowerPattern))
     {
-        cerr << "Error: Could not open books file for writing!" << endl;
-        showUserMenu();
-        return;
+        auto found = postings.find(gram);
+        if (found == postings.end())
+            return {};
+        lists.push_back(&found->second);
     }
 
-    outFile << "ID,Title,Author,Year,Copies\n";
-    for (const auto &book : books)
+    sort(lists.begin(), lists.end(), [](const vector<int> *a, const vector<int> *b)
     {
-        outFile << book[0] << ", \"" << book[1] << "\", \"" << book[2] << "\", "
-                << book[3] << ", " << book[4] << "\n";
-    }
-    outFile.close();
+        return a->size() < b->size();
+    });
 
-    cout << "Press Enter to continue...";
-    cin.ignore();
-    cin.get();
-    showUserMenu();
+    vector<int> result = *lists[0];
+    vector<int> next;
+    for (size_t i = 1; i < lists.size() && !result.empty(); i++)
+    {
+        next.clear();
+        set_intersection(result.begin(), result.end(), lists[i]->begin(), lists[i]->end(), back_inserter(next));
+        result.swap(next);
+    }
+    return result;
 }
 
-void Library::borrowBook()
+// books.bin layout: this header, one CatalogFileRecord per book in ID order,
+// then every title and then every author, each followed by '\n', with the
+// record offsets counted from the start of their own section. That is the
+// layout of a CatalogSegment, so the file is served from its mapping as it
+// is. Version 1 files had an ID index between the records and a single heap
+// holding both titles and authors, and kept the index length and heap size
+// where titlesSize and authorsSize are now. Integers are stored in the
+// writer's byte order; the version field doubles as the check that it
+// matches ours.
+const char catalogFileMagic[8] = {'L', 'I', 'B', 'B', 'O', 'O', 'K', 'S'};
+const uint32_t catalogFileVersion = 2;
+
+struct CatalogFileHeader
 {
-    if (!is_logged_in)
-    {
-        cerr << "Error: Login required\n";
-        return;
-    }
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t recordCount;
+    uint64_t titlesSize;
+    uint64_t authorsSize;
+};
+
+struct CatalogFileRecord
+{
+    int32_t id;
+    int32_t year;
+    int32_t copies;
+    uint32_t titleLength;
+    uint64_t titleOffset;
+    uint64_t authorOffset;
+    uint32_t authorLength;
+    uint32_t reserved;
+};
 
-    displayBooks(false);
+// Available copies per book ID. Borrows and returns adjust them with
+// compare-and-swap, so two borrowers can never both take the last copy,
+// borrows of different books never contend, and a popular book never waits
+// on a lock. Counters live in fixed-size chunks reached through pages of
+// chunk pointers, both allocated only when an ID in their range is first
+// used and installed with compare-and-swap, so any positive ID costs at most
+// one page and one chunk, nothing ever moves, and readers need no lock.
+//
+// A counter not set since the last reset() holds unknown, and reads as the
+// stocked count the caller passes, which is the catalog's. Loading therefore
+// needs no pass over the books to fill the counters in.
+class CopyCounters
+{
+private:
+    static const size_t chunkSize = 1024;
+    static const size_t pageSize = 1024;
+    static const size_t pageCount = size_t(numeric_limits<int>::max()) / chunkSize / pageSize + 1;
+    static const int unknown = numeric_limits<int>::min();
+    using Chunk = atomic<int>;
+    using Page = atomic<Chunk *>;
+    unique_ptr<atomic<Page *>[]> pages;
 
-    int bookId;
-    const int maxTries = 3;
-    int tries = 0;
+    atomic<int> *counter(int id) const;
+    atomic<int> &createCounter(int id);
 
-    do
+public:
+    CopyCounters();
+    ~CopyCounters();
+    CopyCounters(const CopyCounters &) = delete;
+    CopyCounters &operator=(const CopyCounters &) = delete;
+
+    void reset();
+    void set(int id, int copies);
+    int get(int id, int stocked) const;
+    bool tryTake(int id, int stocked);
+    void give(int id, int stocked);
+    int adjust(int id, int stocked, int delta);
+};
+
+CopyCounters::CopyCounters() : pages(new atomic<Page *>[pageCount]())
+{
+}
+
+CopyCounters::~CopyCounters()
+{
+    for (size_t p = 0; p < pageCount; p++)
     {
-        cout << "Enter book ID to borrow: ";
-        if (!(cin >> bookId) || bookId <= 0)
-        {
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cerr << "Invalid ID. Enter a positive number";
-            if (++tries < maxTries)
-            {
-                cerr << " (" << maxTries - tries << " tries remaining): ";
-            }
-            else
-            {
-                cerr << ". Returning to menu.\n";
-                showUserMenu();
-                return;
-            }
-        }
-        else
+        Page *page = pages[p].load();
+        if (!page)
+            continue;
+        for (size_t c = 0; c < pageSize; c++)
         {
-            break;
+            delete[] page[c].load();
         }
-    } while (tries < maxTries);
+        delete[] page;
+    }
+}
 
-    ifstream booksFile("books.txt");
-    if (!booksFile.is_open())
+atomic<int> *CopyCounters::counter(int id) const
+{
+    if (id <= 0)
     {
-        cerr << "Error: Could not open books file! Please try again later.\n";
-        showUserMenu();
-        return;
+        return nullptr;
     }
 
-    vector<vector<string>> books;
-    string line;
-    bool bookFound = false;
-    string bookTitle;
-    int availableCopies = 0;
-
-    getline(booksFile, line);
+    size_t chunk = static_cast<size_t>(id) / chunkSize;
+    Page *page = pages[chunk / pageSize].load(memory_order_acquire);
+    Chunk *counters = page ? page[chunk % pageSize].load(memory_order_acquire) : nullptr;
+    return counters ? &counters[id % chunkSize] : nullptr;
+}
 
-    while (getline(booksFile, line))
+// Allocates the page and chunk holding id if they are missing. When two
+// threads race, the loser frees its copy and uses the winner's.
+atomic<int> &CopyCounters::createCounter(int id)
+{
+    size_t chunk = static_cast<size_t>(id) / chunkSize;
+    atomic<Page *> &pageSlot = pages[chunk / pageSize];
+    Page *page = pageSlot.load(memory_order_acquire);
+    if (!page)
     {
-        vector<string> bookData;
-        stringstream ss(line);
-        string part;
-        bool inQuotes = false;
-        string current;
+        Page *fresh = new Page[pageSize]();
+        if (pageSlot.compare_exchange_strong(page, fresh, memory_order_acq_rel, memory_order_acquire))
+            page = fresh;
+        else
+            delete[] fresh;
+    }
 
-        for (char c : line)
+    Page &chunkSlot = page[chunk % pageSize];
+    Chunk *counters = chunkSlot.load(memory_order_acquire);
+    if (!counters)
+    {
+        Chunk *fresh = new Chunk[chunkSize];
+        for (size_t i = 0; i < chunkSize; i++)
         {
-            if (c == '\"')
-            {
-                inQuotes = !inQuotes;
-            }
-            else if (c == ',' && !inQuotes)
-            {
-                bookData.push_back(cleanString(current));
-                current.clear();
-            }
-            else
-            {
-                current += c;
-            }
+            fresh[i].store(unknown, memory_order_relaxed);
         }
-        bookData.push_back(cleanString(current));
+        if (chunkSlot.compare_exchange_strong(counters, fresh, memory_order_acq_rel, memory_order_acquire))
+            counters = fresh;
+        else
+            delete[] fresh;
+    }
+    return counters[id % chunkSize];
+}
 
-        if (bookData.size() >= 5)
+// Forgets every count, so each reads as its stocked count again. The cost
+// follows the chunks allocated, not the number of books.
+void CopyCounters::reset()
+{
+    for (size_t p = 0; p < pageCount; p++)
+    {
+        Page *page = pages[p].load(memory_order_acquire);
+        for (size_t c = 0; page && c < pageSize; c++)
         {
-            try
-            {
-                books.push_back(bookData);
-                if (stoi(bookData[0]) == bookId)
-                {
-                    bookFound = true;
-                    bookTitle = bookData[1];
-                    availableCopies = stoi(bookData[4]);
-                    if (availableCopies <= 0)
-                    {
-                        cerr << "No copies available of this book.\n";
-                        booksFile.close();
-                        showUserMenu();
-                        return;
-                    }
-                }
-            }
-            catch (const invalid_argument &)
+            Chunk *counters = page[c].load(memory_order_acquire);
+            for (size_t i = 0; counters && i < chunkSize; i++)
             {
-                cerr << "Warning: Invalid book entry skipped.\n";
-                continue;
+                counters[i].store(unknown, memory_order_release);
             }
         }
     }
-    booksFile.close();
+}
 
-    if (!bookFound)
+void CopyCounters::set(int id, int copies)
+{
+    if (id > 0)
     {
-        cerr << "Error: Book with ID " << bookId << " not found in the library.\n";
-        showUserMenu();
-        return;
+        createCounter(id).store(copies, memory_order_release);
     }
+}
+
+int CopyCounters::get(int id, int stocked) const
+{
+    atomic<int> *copies = counter(id);
+    int current = copies ? copies->load(memory_order_acquire) : unknown;
+    return current == unknown ? stocked : current;
+}
 
-    vector<vector<string>> people;
-    bool userFound = false;
-    ifstream peopleIn("People.txt");
-    if (!peopleIn.is_open())
+bool CopyCounters::tryTake(int id, int stocked)
+{
+    if (id <= 0)
     {
-        cerr << "Error: Could not open user records file!\n";
-        showUserMenu();
-        return;
+        return false;
     }
 
-    getline(peopleIn, line);
-
-    while (getline(peopleIn, line))
+    atomic<int> &copies = createCounter(id);
+    int current = copies.load(memory_order_relaxed);
+    while (true)
     {
-        vector<string> person;
-        stringstream ss(line);
-        string part;
-        bool inQuotes = false;
-        string current;
-
-        for (char c : line)
+        int available = (current == unknown) ? stocked : current;
+        if (available <= 0)
         {
-            if (c == '\"')
-            {
-                inQuotes = !inQuotes;
-            }
-            else if (c == ',' && !inQuotes)
-            {
-                person.push_back(cleanString(current));
-                current.clear();
-            }
-            else
-            {
-                current += c;
-            }
+            return false;
         }
-        person.push_back(cleanString(current));
-
-        if (person.size() >= 7)
+        if (copies.compare_exchange_weak(current, available - 1, memory_order_acq_rel, memory_order_relaxed))
         {
-            if (stoi(person[0]) == current_user_id)
-            {
-                userFound = true;
-                if (person[3] == "None")
-                {
-                    person[3] = bookTitle + " (" + to_string(bookId) + ")";
-                }
-                else
-                {
-                    if (person[3].find("(" + to_string(bookId) + ")") != string::npos)
-                    {
-                        cerr << "Error: You have already borrowed this book.\n";
-                        peopleIn.close();
-                        showUserMenu();
-                        return;
-                    }
-                    person[3] += ", " + bookTitle + " (" + to_string(bookId) + ")";
-                }
-
-                time_t now = time(0);
-                if (now == -1)
-                {
-                    cerr << "Error getting current time.\n";
-                    peopleIn.close();
-                    showUserMenu();
-                    return;
-                }
-
-                tm due;
-#ifdef _WIN32
-                if (localtime_s(&due, &now) != 0)
-                {
-                    cerr << "Error converting time.\n";
-                    peopleIn.close();
-                    showUserMenu();
-                    return;
-                }
-#else
-                due = *localtime(&now);
-                if (!localtime(&now))
-                {
-                    cerr << "Error converting time.\n";
-                    peopleIn.close();
-                    showUserMenu();
-                    return;
-                }
-#endif
-
-                due.tm_mday += (current_role == FACULTY) ? 60 : 30;
-                if (mktime(&due) == -1)
-                {
-                    cerr << "Error calculating due date.\n";
-                    peopleIn.close();
-                    showUserMenu();
-                    return;
-                }
-
-                char dateStr[20];
-                if (!strftime(dateStr, sizeof(dateStr), "%Y-%m-%d", &due))
-                {
-                    cerr << "Error formatting date.\n";
-                    peopleIn.close();
-                    showUserMenu();
-                    return;
-                }
-                person[4] = dateStr;
-                person[5] = dateStr;
-            }
-            people.push_back(person);
+            return true;
         }
     }
-    peopleIn.close();
+}
 
-    if (!userFound)
+void CopyCounters::give(int id, int stocked)
+{
+    if (id <= 0)
     {
-        time_t now = time(0);
-        if (now == -1)
-        {
-            cerr << "Error getting current time.\n";
-            showUserMenu();
-            return;
-        }
-
-        tm due;
-#ifdef _WIN32
-        if (localtime_s(&due, &now) != 0)
-        {
-            cerr << "Error converting time.\n";
-            showUserMenu();
-            return;
-        }
-#else
-        due = *localtime(&now);
-        if (!localtime(&now))
-        {
-            cerr << "Error converting time.\n";
-            showUserMenu();
-            return;
-        }
-#endif
-
-        due.tm_mday += (current_role == FACULTY) ? 60 : 30;
-        if (mktime(&due) == -1)
-        {
-            cerr << "Error calculating due date.\n";
-            showUserMenu();
-            return;
-        }
-
-        char dateStr[20];
-        if (!strftime(dateStr, sizeof(dateStr), "%Y-%m-%d", &due))
-        {
-            cerr << "Error formatting date.\n";
-            showUserMenu();
-            return;
-        }
-
-        vector<string> newUser = {
-            to_string(current_user_id),
-            current_username,
-            (current_role == FACULTY) ? "Faculty" : "Student",
-            bookTitle + " (" + to_string(bookId) + ")",
-            dateStr,
-            dateStr,
-            "$0"};
-        people.push_back(newUser);
+        return;
     }
 
-    for (auto &book : books)
+    atomic<int> &copies = createCounter(id);
+    int current = copies.load(memory_order_relaxed);
+    while (!copies.compare_exchange_weak(current, ((current == unknown) ? stocked : current) + 1,
+                                         memory_order_acq_rel, memory_order_relaxed))
     {
-        if (stoi(book[0]) == bookId)
-        {
-            book[4] = to_string(stoi(book[4]) - 1);
-            break;
-        }
     }
+}
 
-    saveBooks(books);
-
-    ofstream peopleOut("People.txt");
-    if (!peopleOut.is_open())
+// Adds delta to the count without letting it drop below zero, and returns
+// the new count.
+int CopyCounters::adjust(int id, int stocked, int delta)
+{
+    if (id <= 0)
     {
-        cerr << "Error: Could not save user records! Changes not saved.\n";
-        showUserMenu();
-        return;
+        return 0;
     }
 
-    peopleOut << "\"ID\", \"Name\", \"Role\", \"Books Borrowed\", \"Time Borrowed\", \"Due Date\", \"Late Fees\"\n";
-    for (const auto &person : people)
+    atomic<int> &copies = createCounter(id);
+    int current = copies.load(memory_order_relaxed);
+    while (true)
     {
-        peopleOut << "\"" << person[0] << "\", \"" << person[1] << "\", \"" << person[2] << "\", \""
-                  << person[3] << "\", \"" << person[4] << "\", \"" << person[5] << "\", \"" << person[6] << "\"\n";
+        long long adjusted = static_cast<long long>((current == unknown) ? stocked : current) + delta;
+        int next = static_cast<int>(min<long long>(max<long long>(adjusted, 0), numeric_limits<int>::max()));
+        if (copies.compare_exchange_weak(current, next, memory_order_acq_rel, memory_order_relaxed))
+        {
+            return next;
+        }
     }
-    peopleOut.close();
-
-    cout << "Successfully borrowed: " << bookTitle << "\n";
-    cout << "Due date: " << people.back()[5] << "\n";
-    showUserMenu();
 }
 
-void Library::returnBook()
+// An immutable run of books in ID order. The books are kept as fixed-size
+// records plus one heap of titles and one of authors, each entry followed by
+// '\n', so a segment is a few allocations rather than two per book and its
+// titles sit back to back for unindexed scans. Every catalog version built
+// on a segment shares it. A segment either owns that data or views it in a
+// mapped books.bin, which has the same layout and is checked once when it
+// is loaded.
+class CatalogSegment
 {
-    if (!is_logged_in)
-    {
-        cerr << "Error: You must be logged in to return books." << endl;
-        return;
-    }
+private:
+    vector<CatalogFileRecord> recordStore;
+    string titleStore;
+    string authorStore;
+    shared_ptr<const char> file;
+
+    const CatalogFileRecord *records;
+    size_t recordCount;
+    string_view titles;
+    string_view authors;
+
+    // Built by the first search that needs them rather than with the
+    // segment, so loading and writing only pay for the records. A segment
+    // that folds changes into one whose structures were already built keeps
+    // that one until then and merges its structures instead of tokenizing
+    // every book again.
+    mutable once_flag searchOnce;
+    mutable atomic<bool> searchBuilt;
+    mutable SearchIndex index;
+    mutable TrigramIndex titleGrams;
+    mutable shared_ptr<const CatalogSegment> previous;
+    mutable vector<int> changedIds;
+
+    // Built by the first lookup by ID. Book IDs are handed out in sequence,
+    // so a table indexed by ID stays dense and answers in constant time.
+    // Segments whose IDs are too sparse for one hash them instead.
+    mutable once_flag slotsOnce;
+    mutable vector<uint32_t> denseSlots;
+    mutable unordered_map<int, uint32_t> sparseSlots;
+
+    static constexpr uint32_t noSlot = numeric_limits<uint32_t>::max();
+
+    void buildSearch() const;
+    void buildSlots() const;
 
-    viewBorrowedBooks(false);
-    int bookId;
-    cout << "Enter the ID of the book you want to return: ";
-    cin >> bookId;
-    cin.ignore();
+public:
+    CatalogSegment();
+
+    void append(int id, string_view title, string_view author, int year, int copies);
+    void appendFrom(const CatalogSegment &other, size_t slot);
+    void view(shared_ptr<const char> mapped, const CatalogFileRecord *first, size_t count,
+              string_view titleSection, string_view authorSection);
+    void derive(shared_ptr<const CatalogSegment> older, vector<int> changed);
+    size_t size() const;
+    size_t lowerBound(int id) const;
+    size_t slotOf(int id) const;
+    int idAt(size_t slot) const;
+    string_view titleAt(size_t slot) const;
+    string_view authorAt(size_t slot) const;
+    int copiesAt(size_t slot) const;
+    Book bookAt(size_t slot) const;
+    string_view titleHeap() const;
+    size_t slotAtTitleOffset(size_t offset) const;
+    const SearchIndex &searchIndex() const;
+    const TrigramIndex &titleIndex() const;
+};
 
-    ifstream booksFile("books.txt");
-    vector<vector<string>> books;
-    string line;
-    bool bookFound = false;
-    string bookTitle;
+CatalogSegment::CatalogSegment()
+{
+    records = nullptr;
+    recordCount = 0;
+    searchBuilt = false;
+}
 
-    while (getline(booksFile, line))
-    {
-        stringstream ss(line);
-        string part;
-        vector<string> parts;
+// IDs must be appended in increasing order.
+void CatalogSegment::append(int id, string_view title, string_view author, int year, int copies)
+{
+    CatalogFileRecord record = {};
+    record.id = id;
+    record.year = year;
+    record.copies = copies;
+    record.titleOffset = titleStore.size();
+    record.titleLength = static_cast<uint32_t>(title.size());
+    record.authorOffset = authorStore.size();
+    record.authorLength = static_cast<uint32_t>(author.size());
+    recordStore.push_back(record);
+    titleStore.append(title);
+    titleStore += '\n';
+    authorStore.append(author);
+    authorStore += '\n';
+
+    records = recordStore.data();
+    recordCount = recordStore.size();
+    titles = titleStore;
+    authors = authorStore;
+}
 
-        while (getline(ss, part, ','))
-        {
-            parts.push_back(cleanString(part));
-        }
+void CatalogSegment::appendFrom(const CatalogSegment &other, size_t slot)
+{
+    const CatalogFileRecord &record = other.records[slot];
+    append(record.id, other.titleAt(slot), other.authorAt(slot), record.year, record.copies);
+}
 
-        if (parts.size() >= 5)
-        {
-            try
-            {
-                int id = stoi(parts[0]);
-                books.push_back(parts);
-            }
-            catch (const invalid_argument &)
-            {
-                cerr << "Warning: invalid book entry skipped.\n";
-                continue;
-            }
-            if (stoi(parts[0]) == bookId)
-            {
-                bookFound = true;
-                bookTitle = parts[1];
-            }
-        }
-    }
-    booksFile.close();
+// Serves the segment from sections of a mapped file, which mapped keeps
+// alive for as long as the segment lasts.
+void CatalogSegment::view(shared_ptr<const char> mapped, const CatalogFileRecord *first, size_t count,
+                          string_view titleSection, string_view authorSection)
+{
+    file = move(mapped);
+    records = first;
+    recordCount = count;
+    titles = titleSection;
+    authors = authorSection;
+}
 
-    if (!bookFound)
+// Records that this segment is older with the books in changed replaced.
+// The link is only kept while it can save work, that is when older's search
+// structures exist and this segment's do not yet.
+void CatalogSegment::derive(shared_ptr<const CatalogSegment> older, vector<int> changed)
+{
+    if (older && older->searchBuilt)
     {
-        cerr << "Book with ID " << bookId << " not found in the library database." << endl;
-        return;
+        previous = move(older);
+        changedIds = move(changed);
     }
+}
 
-    ifstream peopleIn("People.txt");
-    vector<vector<string>> people;
-    bool hasBorrowed = false;
-
-    getline(peopleIn, line);
+size_t CatalogSegment::size() const
+{
+    return recordCount;
+}
 
-    while (getline(peopleIn, line))
+// The slot of the first book with an ID of at least id.
+size_t CatalogSegment::lowerBound(int id) const
+{
+    return lower_bound(records, records + recordCount, id, [](const CatalogFileRecord &record, int value)
     {
-        stringstream ss(line);
-        string part;
-        vector<string> parts;
-        bool inQuotes = false;
-        string current;
-
-        for (char c : line)
-        {
-            if (c == '\"')
-            {
-                inQuotes = !inQuotes;
-            }
-            else if (c == ',' && !inQuotes)
-            {
-                parts.push_back(cleanString(current));
-                current.clear();
-            }
-            else
-            {
-                current += c;
-            }
-        }
-        parts.push_back(cleanString(current));
-
-        if (parts.size() >= 7)
-        {
-            if (stoi(parts[0]) == current_user_id)
-            {
-                string borrowedBooks = parts[3];
-                string bookPattern = bookTitle + " (" + to_string(bookId) + ")";
+        return record.id < value;
+    }) - records;
+}
 
-                size_t pos = borrowedBooks.find(bookPattern);
-                if (pos != string::npos)
-                {
-                    hasBorrowed = true;
-                    if (borrowedBooks == bookPattern)
-                    {
-                        parts[3] = "None";
-                        parts[4] = "N/A";
-                        parts[5] = "N/A";
-                    }
-                    else
-                    {
-                        if (pos > 0 && borrowedBooks[pos - 2] == ',')
-                        {
-                            borrowedBooks.erase(pos - 2, bookPattern.length() + 2);
-                        }
-                        else if (pos + bookPattern.length() < borrowedBooks.length() &&
-                                 borrowedBooks[pos + bookPattern.length()] == ',')
-                        {
-                            borrowedBooks.erase(pos, bookPattern.length() + 2);
-                        }
-                        else
-                        {
-                            borrowedBooks.erase(pos, bookPattern.length());
-                        }
-                        parts[3] = borrowedBooks;
-                    }
-                }
-            }
-            people.push_back(parts);
-        }
+// The slot of the book with this ID, or size() if there is none.
+size_t CatalogSegment::slotOf(int id) const
+{
+    call_once(slotsOnce, [this]() { buildSlots(); });
+    if (id <= 0)
+    {
+        return recordCount;
     }
-    peopleIn.close();
-
-    if (!hasBorrowed)
+    if (!sparseSlots.empty())
     {
-        cerr << "You have not borrowed book \"" << bookTitle << "\" (ID: " << bookId << ")." << endl;
-        return;
+        auto found = sparseSlots.find(id);
+        return (found == sparseSlots.end()) ? recordCount : found->second;
     }
+    size_t index = static_cast<size_t>(id);
+    return (index < denseSlots.size() && denseSlots[index] != noSlot) ? denseSlots[index] : recordCount;
+}
 
-    ofstream peopleOut("People.txt");
-    peopleOut << "\"ID\", \"Name\", \"Role\", \"Books Borrowed\", \"Time Borrowed\", \"Due Date\", \"Late Fees\"\n";
-    for (const auto &person : people)
+void CatalogSegment::buildSlots() const
+{
+    if (recordCount == 0)
     {
-        peopleOut << "\"" << person[0] << "\", \"" << person[1] << "\", \"" << person[2] << "\", \""
-                  << person[3] << "\", \"" << person[4] << "\", \"" << person[5] << "\", \"" << person[6] << "\"\n";
+        return;
     }
-    peopleOut.close();
 
-    for (auto &book : books)
+    size_t highest = static_cast<size_t>(records[recordCount - 1].id);
+    if (highest < max<size_t>(4096, 2 * recordCount))
     {
-        if (stoi(book[0]) == bookId)
+        denseSlots.assign(highest + 1, noSlot);
+        for (size_t slot = 0; slot < recordCount; slot++)
         {
-            book[4] = to_string(stoi(book[4]) + 1);
-            break;
+            denseSlots[records[slot].id] = static_cast<uint32_t>(slot);
         }
+        return;
     }
 
-    ofstream booksOut("books.txt");
-    for (const auto &book : books)
+    sparseSlots.reserve(recordCount);
+    for (size_t slot = 0; slot < recordCount; slot++)
     {
-        booksOut << book[0] << ", \"" << book[1] << "\", \"" << book[2] << "\", "
-                 << book[3] << ", " << book[4] << "\n";
+        sparseSlots.emplace(records[slot].id, static_cast<uint32_t>(slot));
     }
-    booksOut.close();
+}
 
-    cout << "\nYou have successfully returned \"" << bookTitle << "\"!" << endl;
-    cout << "Press Enter to continue...";
-    cin.ignore();
-    cin.get();
-    showUserMenu();
+int CatalogSegment::idAt(size_t slot) const
+{
+    return records[slot].id;
 }
 
-double Library::calculateLateFees(const string &dueDate, UserRole role)
+string_view CatalogSegment::titleAt(size_t slot) const
 {
-    if (dueDate == "N/A" || dueDate.empty())
-    {
-        return 0.0;
-    }
+    const CatalogFileRecord &record = records[slot];
+    return titles.substr(record.titleOffset, record.titleLength);
+}
 
-    int year, month, day;
-    if (sscanf(dueDate.c_str(), "%d-%d-%d", &year, &month, &day) != 3)
-    {
-        cerr << "Warning: Invalid due date format: " << dueDate << "\n";
-        return 0.0;
-    }
+string_view CatalogSegment::authorAt(size_t slot) const
+{
+    const CatalogFileRecord &record = records[slot];
+    return authors.substr(record.authorOffset, record.authorLength);
+}
 
-    time_t now = time(0);
-    if (now == -1)
-    {
-        cerr << "Error getting current time.\n";
-        return 0.0;
-    }
+int CatalogSegment::copiesAt(size_t slot) const
+{
+    return records[slot].copies;
+}
 
-    tm currentTm;
-#ifdef _WIN32
-    if (localtime_s(&currentTm, &now) != 0)
-    {
-        cerr << "Error converting current time.\n";
-        return 0.0;
-    }
-#else
-    tm *temp = localtime(&now);
-    if (!temp)
-    {
-        cerr << "Error converting current time.\n";
-        return 0.0;
-    }
-    currentTm = *temp;
-#endif
+Book CatalogSegment::bookAt(size_t slot) const
+{
+    const CatalogFileRecord &record = records[slot];
+    return {record.id, string(titleAt(slot)), string(authorAt(slot)), record.year, record.copies};
+}
 
-    tm dueTm = {0};
-    dueTm.tm_year = year - 1900;
-    dueTm.tm_mon = month - 1;
-    dueTm.tm_mday = day;
+string_view CatalogSegment::titleHeap() const
+{
+    return titles;
+}
 
-    if (dueTm.tm_year < 0 || dueTm.tm_mon < 0 || dueTm.tm_mon > 11 || dueTm.tm_mday < 1 || dueTm.tm_mday > 31)
+// The slot whose title covers this offset into titleHeap().
+size_t CatalogSegment::slotAtTitleOffset(size_t offset) const
+{
+    return upper_bound(records, records + recordCount, offset, [](size_t value, const CatalogFileRecord &record)
     {
-        cerr << "Warning: Invalid due date components: " << dueDate << "\n";
-        return 0.0;
-    }
+        return value < record.titleOffset;
+    }) - records - 1;
+}
 
-    time_t dueTime = mktime(&dueTm);
-    if (dueTime == -1)
+void CatalogSegment::buildSearch() const
+{
+    if (previous)
     {
-        cerr << "Error converting due date.\n";
-        return 0.0;
-    }
+        SearchIndex addedIndex;
+        TrigramIndex addedGrams;
+        for (int id : changedIds)
+        {
+            size_t slot = slotOf(id);
+            if (slot < recordCount)
+            {
+                addedIndex.add(id, titleAt(slot), authorAt(slot));
+                addedGrams.add(id, titleAt(slot));
+            }
+        }
 
-    double secondsLate = difftime(now, dueTime);
-    if (secondsLate <= 0)
+        auto keep = [this](int id)
+        {
+            return !binary_search(changedIds.begin(), changedIds.end(), id);
+        };
+        index.merge(previous->searchIndex(), keep, addedIndex);
+        titleGrams.merge(previous->titleIndex(), keep, addedGrams);
+        previous.reset();
+        changedIds = vector<int>();
+    }
+    else
     {
-        return 0.0;
+        for (size_t slot = 0; slot < recordCount; slot++)
+        {
+            index.add(records[slot].id, titleAt(slot), authorAt(slot));
+            titleGrams.add(records[slot].id, titleAt(slot));
+        }
     }
+    searchBuilt = true;
+}
 
-    const int secondsPerDay = 60 * 60 * 24;
-    int daysLate = static_cast<int>(secondsLate / secondsPerDay);
-
-    double feePerDay = (role == FACULTY) ? 0.50 : 1.00;
-    double fee = daysLate * feePerDay;
+const SearchIndex &CatalogSegment::searchIndex() const
+{
+    call_once(searchOnce, [this]() { buildSearch(); });
+    return index;
+}
 
-    return max(0.0, fee);
+const TrigramIndex &CatalogSegment::titleIndex() const
+{
+    call_once(searchOnce, [this]() { buildSearch(); });
+    return titleGrams;
 }
 
-void Library::checkLateFees()
+// One version of the catalog: a shared base segment plus the books changed
+// since that segment was made, where a change without a book is a removal.
+// The changes are kept in levels, newest first: a short sorted tail that
+// each write copies and edits, then immutable runs that every version
+// built on them shares. Each run has its own lookup table and search
+// structures, so lookups, searches and copies cost a handful of probes per
+// level rather than a pass over every change. A full tail becomes a run,
+// and runs are merged with their older neighbours as they grow, so each
+// change is merged a logarithmic number of times. Once the changes outgrow
+// a small fraction of the base, they are folded into a new base segment.
+class Catalog
 {
-    if (current_role != ADMIN)
+private:
+    // A changed book with its tokens counted once, so searches can score it
+    // without an index.
+    struct ChangedBook
     {
-        cerr << "Error: You don't have permission to view all late fees." << endl;
-        return;
-    }
-
-    ifstream peopleFile("People.txt");
-    if (!peopleFile.is_open())
+        Book book;
+        SearchIndex::Terms terms;
+    };
+
+    // replaced is the book the older levels and the base held for id when
+    // this level first changed it, so a level knows how it moves each
+    // token's document frequency.
+    struct Change
+    {
+        int id;
+        shared_ptr<const ChangedBook> book;
+        shared_ptr<const ChangedBook> replaced;
+    };
+
+    // An immutable, sorted run of changes. index and titleGrams cover the
+    // books it holds; dfDelta is how many more books contain each token
+    // with the run applied than without it.
+    struct ChangeRun
+    {
+        vector<Change> changes;
+        unordered_map<int, uint32_t> slotById;
+        SearchIndex index;
+        TrigramIndex titleGrams;
+        unordered_map<string, long long> dfDelta;
+
+        const Change *find(int id) const;
+    };
+
+    static constexpr size_t minFoldChanges = 1024;
+    static constexpr size_t foldDivisor = 64;
+    static constexpr size_t tailCapacity = 64;
+    static constexpr size_t runGrowth = 4;
+
+    string filename;
+    string binaryFilename;
+    bool binary;
+    bool loadFailed;
+    shared_ptr<const CatalogSegment> base;
+    vector<shared_ptr<const ChangeRun>> runs;
+    vector<Change> tail;
+    size_t bookCount;
+    int highestId;
+    LoadStats lastLoad;
+
+    static shared_ptr<const ChangeRun> makeRun(vector<Change> changes);
+    static shared_ptr<const ChangeRun> mergeRuns(const ChangeRun &older, const ChangeRun &newer);
+    const Change *findChange(int id) const;
+    const Change *findChange(int id, size_t levels) const;
+    shared_ptr<const ChangedBook> olderBook(int id) const;
+    void setChange(int id, const Book *book);
+    void flushTail();
+    void foldIfDue();
+    template <typename Visitor>
+    void walk(int firstId, Visitor visit) const;
+    void reset(shared_ptr<const CatalogSegment> segment);
+    bool loadText();
+    bool loadBinary();
+    bool saveText(const CopyCounters &available) const;
+    bool saveBinary(const CopyCounters &available) const;
+
+public:
+    explicit Catalog(const string &file = "books.txt", const string &binaryFile = "books.bin");
+
+    bool load();
+    bool save(const CopyCounters &available) const;
+    void setBinary(bool enabled);
+    const LoadStats &loadStats() const;
+    bool add(Book book);
+    void upsert(const Book &book);
+    bool remove(int id);
+
+    template <typename Visitor>
+    void forEach(Visitor visit) const;
+    template <typename Visitor>
+    int forEachAfter(int afterId, size_t limit, Visitor visit) const;
+    bool find(int id, Book &book) const;
+    bool contains(int id) const;
+    int maxId() const;
+    size_t size() const;
+    vector<int> search(string_view query) const;
+    vector<int> findTitlesContaining(string_view text) const;
+};
+
+const Catalog::Change *Catalog::ChangeRun::find(int id) const
+{
+    auto found = slotById.find(id);
+    return (found == slotById.end()) ? nullptr : &changes[found->second];
+}
+
+Catalog::Catalog(const string &file, const string &binaryFile)
+{
+    filename = file;
+    binaryFilename = binaryFile;
+    binary = false;
+    loadFailed = false;
+    reset(make_shared<const CatalogSegment>());
+}
+
+void Catalog::reset(shared_ptr<const CatalogSegment> segment)
+{
+    base = move(segment);
+    runs.clear();
+    tail.clear();
+    bookCount = base->size();
+    highestId = bookCount > 0 ? base->idAt(bookCount - 1) : 0;
+}
+
+shared_ptr<const Catalog::ChangeRun> Catalog::makeRun(vector<Change> changes)
+{
+    auto run = make_shared<ChangeRun>();
+    run->changes = move(changes);
+    run->slotById.reserve(run->changes.size());
+    for (size_t slot = 0; slot < run->changes.size(); slot++)
+    {
+        const Change &change = run->changes[slot];
+        run->slotById.emplace(change.id, static_cast<uint32_t>(slot));
+        if (change.book)
+        {
+            run->index.add(change.book->terms);
+            run->titleGrams.add(change.id, change.book->book.title);
+            for (const auto &term : change.book->terms)
+                run->dfDelta[term.first]++;
+        }
+        if (change.replaced)
+        {
+            for (const auto &term : change.replaced->terms)
+                run->dfDelta[term.first]--;
+        }
+    }
+    for (auto delta = run->dfDelta.begin(); delta != run->dfDelta.end();)
+    {
+        delta = (delta->second == 0) ? run->dfDelta.erase(delta) : next(delta);
+    }
+    return run;
+}
+
+// The newer run's change to an ID wins, but keeps the older run's replaced
+// book, which is what was below both. A removal of a book nothing below
+// held cancels out. The search structures are merged rather than rebuilt.
+shared_ptr<const Catalog::ChangeRun> Catalog::mergeRuns(const ChangeRun &older, const ChangeRun &newer)
+{
+    auto run = make_shared<ChangeRun>();
+    vector<Change> &merged = run->changes;
+    merged.reserve(older.changes.size() + newer.changes.size());
+    auto from = older.changes.begin();
+    auto added = newer.changes.begin();
+    while (from != older.changes.end() || added != newer.changes.end())
+    {
+        if (added == newer.changes.end() || (from != older.changes.end() && from->id < added->id))
+        {
+            merged.push_back(*from++);
+        }
+        else if (from == older.changes.end() || added->id < from->id)
+        {
+            merged.push_back(*added++);
+        }
+        else
+        {
+            if (added->book || from->replaced)
+                merged.push_back(Change{added->id, added->book, from->replaced});
+            ++from;
+            ++added;
+        }
+    }
+
+    run->slotById.reserve(merged.size());
+    for (size_t slot = 0; slot < merged.size(); slot++)
+    {
+        run->slotById.emplace(merged[slot].id, static_cast<uint32_t>(slot));
+    }
+
+    auto keep = [&newer](int id)
+    {
+        return newer.find(id) == nullptr;
+    };
+    run->index.merge(older.index, keep, newer.index);
+    run->titleGrams.merge(older.titleGrams, keep, newer.titleGrams);
+
+    run->dfDelta = older.dfDelta;
+    for (const auto &delta : newer.dfDelta)
+    {
+        if ((run->dfDelta[delta.first] += delta.second) == 0)
+            run->dfDelta.erase(delta.first);
+    }
+    return run;
+}
+
+const Catalog::Change *Catalog::findChange(int id) const
+{
+    return findChange(id, runs.size());
+}
+
+// The newest change to id in the tail or the first levels runs, or null.
+const Catalog::Change *Catalog::findChange(int id, size_t levels) const
+{
+    auto found = lower_bound(tail.begin(), tail.end(), id, [](const Change &change, int value)
+    {
+        return change.id < value;
+    });
+    if (found != tail.end() && found->id == id)
+    {
+        return &*found;
+    }
+    for (size_t level = 0; level < levels; level++)
+    {
+        const Change *change = runs[level]->find(id);
+        if (change)
+            return change;
+    }
+    return nullptr;
+}
+
+// The book the runs and the base hold for id, or null.
+shared_ptr<const Catalog::ChangedBook> Catalog::olderBook(int id) const
+{
+    for (const auto &run : runs)
+    {
+        const Change *change = run->find(id);
+        if (change)
+            return change->book;
+    }
+
+    size_t slot = base->slotOf(id);
+    if (slot == base->size())
+    {
+        return nullptr;
+    }
+    Book book = base->bookAt(slot);
+    SearchIndex::Terms terms = SearchIndex::countTokens(book.id, book.title, book.author);
+    return make_shared<const ChangedBook>(ChangedBook{move(book), move(terms)});
+}
+
+// A null book records a removal. Removing a book that only the tail held
+// leaves no trace.
+void Catalog::setChange(int id, const Book *book)
+{
+    shared_ptr<const ChangedBook> changed;
+    if (book)
+    {
+        changed = make_shared<const ChangedBook>(
+            ChangedBook{*book, SearchIndex::countTokens(book->id, book->title, book->author)});
+    }
+
+    auto found = lower_bound(tail.begin(), tail.end(), id, [](const Change &change, int value)
+    {
+        return change.id < value;
+    });
+    if (found != tail.end() && found->id == id)
+    {
+        found->book = move(changed);
+        if (!found->book && !found->replaced)
+            tail.erase(found);
+        return;
+    }
+
+    shared_ptr<const ChangedBook> replaced = olderBook(id);
+    if (changed || replaced)
+        tail.insert(found, Change{id, move(changed), move(replaced)});
+}
+
+// Turns the tail into the newest run and merges it into the older runs
+// while they are less than runGrowth times its size.
+void Catalog::flushTail()
+{
+    shared_ptr<const ChangeRun> run = makeRun(move(tail));
+    tail.clear();
+
+    size_t merged = 0;
+    while (merged < runs.size() && runs[merged]->changes.size() <= runGrowth * run->changes.size())
+    {
+        run = mergeRuns(*runs[merged], *run);
+        merged++;
+    }
+    runs.erase(runs.begin(), runs.begin() + merged);
+    runs.insert(runs.begin(), move(run));
+}
+
+void Catalog::foldIfDue()
+{
+    size_t pending = tail.size();
+    for (const auto &run : runs)
+    {
+        pending += run->changes.size();
+    }
+
+    if (pending > max(minFoldChanges, base->size() / foldDivisor))
+    {
+        auto folded = make_shared<CatalogSegment>();
+        vector<int> changedIds;
+        changedIds.reserve(pending);
+        for (const Change &change : tail)
+        {
+            changedIds.push_back(change.id);
+        }
+        for (const auto &run : runs)
+        {
+            for (const Change &change : run->changes)
+                changedIds.push_back(change.id);
+        }
+        sort(changedIds.begin(), changedIds.end());
+        changedIds.erase(unique(changedIds.begin(), changedIds.end()), changedIds.end());
+
+        walk(1, [&](const Book *changed, size_t slot)
+        {
+            if (changed)
+                folded->append(changed->id, changed->title, changed->author, changed->year, changed->copies);
+            else
+                folded->appendFrom(*base, slot);
+            return true;
+        });
+        folded->derive(base, move(changedIds));
+        reset(move(folded));
+    }
+    else if (tail.size() >= tailCapacity)
+    {
+        flushTail();
+    }
+}
+
+// Visits the books with IDs of at least firstId in ID order, merging the
+// base with every level of changes, the newest level winning, until visit
+// returns false. visit gets either a changed book or, when that is null,
+// the slot of a base book.
+template <typename Visitor>
+void Catalog::walk(int firstId, Visitor visit) const
+{
+    auto byId = [](const Change &entry, int value)
+    {
+        return entry.id < value;
+    };
+    vector<pair<const Change *, const Change *>> levels;
+    levels.reserve(runs.size() + 1);
+    levels.push_back({lower_bound(tail.data(), tail.data() + tail.size(), firstId, byId), tail.data() + tail.size()});
+    for (const auto &run : runs)
+    {
+        const Change *end = run->changes.data() + run->changes.size();
+        levels.push_back({lower_bound(run->changes.data(), end, firstId, byId), end});
+    }
+
+    size_t slot = base->lowerBound(firstId);
+    while (true)
+    {
+        const Change *change = nullptr;
+        for (const auto &level : levels)
+        {
+            if (level.first != level.second && (!change || level.first->id < change->id))
+                change = level.first;
+        }
+
+        if (change && (slot == base->size() || change->id <= base->idAt(slot)))
+        {
+            for (auto &level : levels)
+            {
+                if (level.first != level.second && level.first->id == change->id)
+                    level.first++;
+            }
+            if (slot < base->size() && base->idAt(slot) == change->id)
+                slot++;
+            if (change->book && !visit(&change->book->book, size_t(0)))
+                return;
+        }
+        else if (slot == base->size() || !visit(static_cast<const Book *>(nullptr), slot++))
+        {
+            return;
+        }
+    }
+}
+
+bool Catalog::add(Book book)
+{
+    if (book.id <= 0 || contains(book.id))
+    {
+        return false;
+    }
+
+    setChange(book.id, &book);
+    bookCount++;
+    highestId = max(highestId, book.id);
+    foldIfDue();
+    return true;
+}
+
+void Catalog::upsert(const Book &book)
+{
+    if (book.id <= 0)
     {
-        cerr << "Error: Could not open people file!" << endl;
         return;
     }
 
-    cout << "\n=== Users with Late Fees ===\n";
-    string line;
-    bool headerShown = false;
+    if (!contains(book.id))
+        bookCount++;
+    setChange(book.id, &book);
+    highestId = max(highestId, book.id);
+    foldIfDue();
+}
+
+bool Catalog::remove(int id)
+{
+    if (!contains(id))
+    {
+        return false;
+    }
+
+    setChange(id, nullptr);
+    bookCount--;
+    foldIfDue();
+    return true;
+}
+
+// books.bin takes precedence over books.txt when both exist.
+bool Catalog::load()
+{
+    reset(make_shared<const CatalogSegment>());
+
+    ifstream probe(binaryFilename);
+    binary = probe.is_open();
+    probe.close();
+    loadFailed = !(binary ? loadBinary() : loadText());
+    return !loadFailed;
+}
+
+bool Catalog::loadText()
+{
+    vector<Book> rows;
+    bool opened = loadLinesParallel<Book>(filename, "ID", [](string_view line, Book &book)
+    {
+        string_view fields[5];
+        return parseBook(fields, splitRecord(line, fields, 5), book);
+    },
+    [&](vector<Book> &chunk, const vector<string_view> &rejected)
+    {
+        for (string_view line : rejected)
+        {
+            cerr << "Warning: Invalid book record format - " << line << endl;
+        }
+        move(chunk.begin(), chunk.end(), back_inserter(rows));
+    }, lastLoad);
+
+    if (!opened)
+    {
+        cerr << "Error: Could not open books file!" << endl;
+        return false;
+    }
+
+    // The file is normally in ID order already; a stable sort keeps the
+    // first of any duplicates in front, which is the row that wins.
+    stable_sort(rows.begin(), rows.end(), [](const Book &a, const Book &b)
+    {
+        return a.id < b.id;
+    });
+    auto segment = make_shared<CatalogSegment>();
+    int lastId = 0;
+    for (const Book &book : rows)
+    {
+        if (book.id <= lastId)
+        {
+            cerr << "Warning: Duplicate or invalid book ID skipped - " << book.id << endl;
+            continue;
+        }
+        segment->append(book.id, book.title, book.author, book.year, book.copies);
+        lastId = book.id;
+    }
+    reset(move(segment));
+    return true;
+}
+
+// Version 2 files are served from the mapping after one pass over the
+// records, which checks that IDs are positive and strictly increasing and
+// that every title and author is where a save would have put it: inside its
+// section, right after the previous one and followed by '\n'. Searches and
+// lookups rely on exactly that, so a file that fails any check is rejected
+// rather than served. Version 1 files are copied into memory, with the
+// same checks on IDs and every range bounds-checked, and the next save
+// writes version 2.
+bool Catalog::loadBinary()
+{
+    auto started = chrono::steady_clock::now();
+    size_t length = 0;
+    const char *data = mapFile(binaryFilename, length);
+    if (!data)
+    {
+        cerr << "Error: Could not open binary books file!" << endl;
+        return false;
+    }
+
+#ifdef _WIN32
+    // Windows cannot replace a file while it is mapped, and saving replaces
+    // books.bin, so the contents are copied out and the view closed.
+    char *copy = new char[length];
+    memcpy(copy, data, length);
+    unmapFile(data, length);
+    shared_ptr<const char> mapped(copy, default_delete<const char[]>());
+#else
+    shared_ptr<const char> mapped(data, [length](const char *view) { unmapFile(view, length); });
+#endif
+    data = mapped.get();
+
+    CatalogFileHeader header;
+    bool valid = length >= sizeof(header);
+    uint64_t space = 0;
+    if (valid)
+    {
+        memcpy(&header, data, sizeof(header));
+        space = length - sizeof(header);
+        valid = memcmp(header.magic, catalogFileMagic, sizeof(header.magic)) == 0 &&
+                (header.version == 1 || header.version == catalogFileVersion) &&
+                header.recordSize == sizeof(CatalogFileRecord) &&
+                header.recordCount <= space / sizeof(CatalogFileRecord);
+    }
+    if (valid)
+    {
+        space -= header.recordCount * sizeof(CatalogFileRecord);
+        valid = header.version == 1 ? header.titlesSize <= space / sizeof(int32_t) &&
+                                          header.authorsSize == space - header.titlesSize * sizeof(int32_t)
+                                    : header.titlesSize <= space && header.authorsSize == space - header.titlesSize;
+    }
+
+    auto segment = make_shared<CatalogSegment>();
+    const char *recordsAt = data + sizeof(header);
+    if (valid && header.version == catalogFileVersion)
+    {
+        const char *titlesAt = recordsAt + header.recordCount * sizeof(CatalogFileRecord);
+        string_view titles(titlesAt, header.titlesSize);
+        string_view authors(titlesAt + header.titlesSize, header.authorsSize);
+        const CatalogFileRecord *records = reinterpret_cast<const CatalogFileRecord *>(recordsAt);
+        valid = reinterpret_cast<uintptr_t>(recordsAt) % alignof(CatalogFileRecord) == 0;
+        uint64_t titleEnd = 0;
+        uint64_t authorEnd = 0;
+        for (uint64_t i = 0; i < header.recordCount && valid; i++)
+        {
+            const CatalogFileRecord &record = records[i];
+            valid = record.id > 0 && (i == 0 || records[i - 1].id < record.id) &&
+                    record.titleOffset == titleEnd && record.titleLength < titles.size() - titleEnd &&
+                    titles[titleEnd + record.titleLength] == '\n' && record.authorOffset == authorEnd &&
+                    record.authorLength < authors.size() - authorEnd &&
+                    authors[authorEnd + record.authorLength] == '\n';
+            titleEnd += record.titleLength + 1;
+            authorEnd += record.authorLength + 1;
+        }
+        valid = valid && titleEnd == titles.size() && authorEnd == authors.size();
+        if (valid)
+            segment->view(move(mapped), records, header.recordCount, titles, authors);
+    }
+    else if (valid)
+    {
+        const char *heap = recordsAt + header.recordCount * sizeof(CatalogFileRecord) +
+                           header.titlesSize * sizeof(int32_t);
+        for (uint64_t i = 0; i < header.recordCount && valid; i++)
+        {
+            CatalogFileRecord record;
+            memcpy(&record, recordsAt + i * sizeof(record), sizeof(record));
+            valid = record.id > 0 && record.titleOffset <= header.authorsSize &&
+                    record.titleLength <= header.authorsSize - record.titleOffset &&
+                    record.authorOffset <= header.authorsSize &&
+                    record.authorLength <= header.authorsSize - record.authorOffset &&
+                    (i == 0 || segment->idAt(i - 1) < record.id);
+            if (valid)
+            {
+                segment->append(record.id, string_view(heap + record.titleOffset, record.titleLength),
+                                string_view(heap + record.authorOffset, record.authorLength), record.year,
+                                record.copies);
+            }
+        }
+    }
+
+    lastLoad.bytes = length;
+    lastLoad.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    lastLoad.threads = 1;
+    if (!valid)
+    {
+        cerr << "Error: " << binaryFilename << " is damaged or was written by an incompatible version!" << endl;
+        return false;
+    }
+    reset(move(segment));
+    return true;
+}
+
+// The copies column comes from the live counters rather than the records,
+// which only hold the count as of the book's last edit. A catalog whose file
+// could not be loaded is missing its books, so it is never saved over that
+// file; the journal keeps the changes instead.
+bool Catalog::save(const CopyCounters &available) const
+{
+    if (loadFailed)
+    {
+        cerr << "Error: The books file could not be loaded, so it was not overwritten." << endl;
+        return false;
+    }
+    return binary ? saveBinary(available) : saveText(available);
+}
+
+void Catalog::setBinary(bool enabled)
+{
+    binary = enabled;
+}
+
+const LoadStats &Catalog::loadStats() const
+{
+    return lastLoad;
+}
+
+bool Catalog::saveBinary(const CopyCounters &available) const
+{
+    AtomicFileWriter booksOut(binaryFilename);
+    if (!booksOut.isOpen())
+    {
+        cerr << "Error: Could not open binary books file for writing!" << endl;
+        return false;
+    }
+
+    vector<CatalogFileRecord> records;
+    string titles;
+    string authors;
+    records.reserve(bookCount);
+    forEach([&](const Book &book)
+    {
+        CatalogFileRecord record = {};
+        record.id = book.id;
+        record.year = book.year;
+        record.copies = available.get(book.id, book.copies);
+        record.titleOffset = titles.size();
+        record.titleLength = static_cast<uint32_t>(book.title.size());
+        titles += book.title;
+        titles += '\n';
+        record.authorOffset = authors.size();
+        record.authorLength = static_cast<uint32_t>(book.author.size());
+        authors += book.author;
+        authors += '\n';
+        records.push_back(record);
+    });
+
+    CatalogFileHeader header = {};
+    memcpy(header.magic, catalogFileMagic, sizeof(header.magic));
+    header.version = catalogFileVersion;
+    header.recordSize = sizeof(CatalogFileRecord);
+    header.recordCount = records.size();
+    header.titlesSize = titles.size();
+    header.authorsSize = authors.size();
+
+    booksOut.write(string_view(reinterpret_cast<const char *>(&header), sizeof(header)));
+    booksOut.write(string_view(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(records[0])));
+    booksOut.write(titles);
+    booksOut.write(authors);
+
+    if (!booksOut.commit())
+    {
+        cerr << "Error: Could not save binary books file! The previous version was kept." << endl;
+        return false;
+    }
+    return true;
+}
+
+bool Catalog::saveText(const CopyCounters &available) const
+{
+    AtomicFileWriter booksOut(filename);
+    if (!booksOut.isOpen())
+    {
+        cerr << "Error: Could not open books file for writing!" << endl;
+        return false;
+    }
+
+    booksOut.write("ID,Title,Author,Year,Copies\n");
+    forEach([&](const Book &book)
+    {
+        booksOut.write(formatBook(book, available.get(book.id, book.copies)));
+        booksOut.write("\n");
+    });
+
+    if (!booksOut.commit())
+    {
+        cerr << "Error: Could not save books file! The previous version was kept." << endl;
+        return false;
+    }
+    return true;
+}
+
+template <typename Visitor>
+void Catalog::forEach(Visitor visit) const
+{
+    walk(1, [&](const Book *changed, size_t slot)
+    {
+        if (changed)
+            visit(*changed);
+        else
+            visit(base->bookAt(slot));
+        return true;
+    });
+}
+
+// Keyset pagination: visits up to limit books with IDs above afterId, in ID
+// order, and returns the cursor for the next page, or 0 once no books are
+// left. A page costs a binary search plus its own size.
+template <typename Visitor>
+int Catalog::forEachAfter(int afterId, size_t limit, Visitor visit) const
+{
+    if (afterId >= highestId)
+    {
+        return 0;
+    }
+
+    int lastId = max(afterId, 0);
+    int next = 0;
+    walk(lastId + 1, [&](const Book *changed, size_t slot)
+    {
+        if (limit == 0)
+        {
+            next = lastId;
+            return false;
+        }
+        Book book = changed ? *changed : base->bookAt(slot);
+        lastId = book.id;
+        visit(book);
+        limit--;
+        return true;
+    });
+    return next;
+}
+
+bool Catalog::find(int id, Book &book) const
+{
+    const Change *change = findChange(id);
+    if (change)
+    {
+        if (!change->book)
+            return false;
+        book = change->book->book;
+        return true;
+    }
+
+    size_t slot = base->slotOf(id);
+    if (slot == base->size())
+    {
+        return false;
+    }
+    book = base->bookAt(slot);
+    return true;
+}
+
+bool Catalog::contains(int id) const
+{
+    const Change *change = findChange(id);
+    return change ? change->book != nullptr : base->slotOf(id) < base->size();
+}
+
+int Catalog::maxId() const
+{
+    return highestId;
+}
+
+size_t Catalog::size() const
+{
+    return bookCount;
+}
+
+// Ranks the base and each run through their indexes and scores the tail's
+// books from their own token counts, leaving out books a newer level
+// changed. A token weighs more the rarer it is in the catalog as a whole,
+// so the order does not depend on how many changes are still outside the
+// base.
+vector<int> Catalog::search(string_view query) const
+{
+    vector<string> tokens;
+    forEachToken(query, [&](const string &token)
+    {
+        tokens.push_back(token);
+    });
+    sort(tokens.begin(), tokens.end());
+    tokens.erase(unique(tokens.begin(), tokens.end()), tokens.end());
+    if (tokens.empty())
+    {
+        return {};
+    }
+
+    auto hasTerm = [](const SearchIndex::Terms &terms, const string &token)
+    {
+        auto term = lower_bound(terms.begin(), terms.end(), token, [](const auto &entry, const string &value)
+        {
+            return entry.first < value;
+        });
+        return (term != terms.end() && term->first == token) ? &term->second : nullptr;
+    };
+
+    const SearchIndex &index = base->searchIndex();
+    vector<double> weights;
+    for (const string &token : tokens)
+    {
+        const vector<SearchIndex::Posting> *list = index.find(token);
+        long long containing = list ? static_cast<long long>(list->size()) : 0;
+        for (const auto &run : runs)
+        {
+            auto delta = run->dfDelta.find(token);
+            if (delta != run->dfDelta.end())
+                containing += delta->second;
+        }
+        for (const Change &change : tail)
+        {
+            containing += (change.book && hasTerm(change.book->terms, token));
+            containing -= (change.replaced && hasTerm(change.replaced->terms, token));
+        }
+        weights.push_back(log(1.0 + static_cast<double>(bookCount) / max<long long>(containing, 1)));
+    }
+
+    vector<pair<double, int>> ranked = index.rank(tokens, weights, [this](int id)
+    {
+        return findChange(id) != nullptr;
+    });
+    for (size_t level = 0; level < runs.size(); level++)
+    {
+        vector<pair<double, int>> fromRun = runs[level]->index.rank(tokens, weights, [&](int id)
+        {
+            return findChange(id, level) != nullptr;
+        });
+        ranked.insert(ranked.end(), fromRun.begin(), fromRun.end());
+    }
+    for (const Change &change : tail)
+    {
+        if (!change.book)
+            continue;
+
+        double score = 0;
+        bool inAll = true;
+        for (size_t i = 0; i < tokens.size() && inAll; i++)
+        {
+            const SearchIndex::Posting *term = hasTerm(change.book->terms, tokens[i]);
+            inAll = term != nullptr;
+            if (inAll)
+                score += (2.0 * term->titleHits + term->authorHits) * weights[i];
+        }
+        if (inAll)
+            ranked.push_back({-score, change.id});
+    }
+
+    sort(ranked.begin(), ranked.end());
+    vector<int> ids;
+    ids.reserve(ranked.size());
+    for (const auto &entry : ranked)
+    {
+        ids.push_back(entry.second);
+    }
+    return ids;
+}
+
+// Case-insensitive substring match on titles, in ID order. In the base and
+// the runs, patterns of three or more bytes are answered from the trigram
+// indexes. Shorter ones are too unselective for them; the base matches
+// those with one vectorized pass over its title heap and the runs check
+// their books one by one. The tail's books are always checked one by one.
+vector<int> Catalog::findTitlesContaining(string_view text) const
+{
+    string pattern(text);
+    transform(pattern.begin(), pattern.end(), pattern.begin(), ::tolower);
+
+    vector<int> matches;
+    if (pattern.size() < 3)
+    {
+        string_view heap = base->titleHeap();
+        size_t pos = 0;
+        while (pos < heap.size() && (pos = findIgnoreCase(heap, pattern, pos)) != string_view::npos)
+        {
+            size_t slot = base->slotAtTitleOffset(pos);
+            size_t next = pos + 1;
+            if (slot < base->size())
+            {
+                string_view title = base->titleAt(slot);
+                if (!findChange(base->idAt(slot)))
+                    matches.push_back(base->idAt(slot));
+                next = max(next, static_cast<size_t>(title.data() - heap.data()) + title.size() + 1);
+            }
+            pos = next;
+        }
+    }
+    else
+    {
+        for (int bookId : base->titleIndex().candidates(pattern))
+        {
+            if (!findChange(bookId) && containsIgnoreCase(base->titleAt(base->slotOf(bookId)), pattern))
+                matches.push_back(bookId);
+        }
+    }
+
+    size_t fromBase = matches.size();
+    for (size_t level = 0; level < runs.size(); level++)
+    {
+        auto check = [&](const Change &change)
+        {
+            if (change.book && !findChange(change.id, level) && containsIgnoreCase(change.book->book.title, pattern))
+                matches.push_back(change.id);
+        };
+        const ChangeRun &run = *runs[level];
+        if (pattern.size() < 3)
+        {
+            for (const Change &change : run.changes)
+                check(change);
+        }
+        else
+        {
+            for (int bookId : run.titleGrams.candidates(pattern))
+                check(*run.find(bookId));
+        }
+    }
+    for (const Change &change : tail)
+    {
+        if (change.book && containsIgnoreCase(change.book->book.title, pattern))
+            matches.push_back(change.id);
+    }
+    sort(matches.begin() + fromBase, matches.end());
+    inplace_merge(matches.begin(), matches.begin() + fromBase, matches.end());
+    return matches;
+}
+
+// Hands out book and user IDs from monotonically increasing sequences that
+// survive restarts. Allocating only bumps a counter in memory. The next free
+// value of each sequence is written to a small key=value file with every
+// snapshot, and the journal's add and patron records reserve the IDs handed
+// out since, so an ID is never reused even if its book was added and
+// removed before the next snapshot. Once an ID as high as INT_MAX is in use
+// the sequence is spent, and allocating returns 0.
+class IdAllocator
+{
+private:
+    string filename;
+    long long nextBookId;
+    long long nextUserId;
+
+public:
+    explicit IdAllocator(const string &file = "library.meta");
+
+    bool load();
+    bool save() const;
+    void reserveBookIds(int highestUsed);
+    void reserveUserIds(int highestUsed);
+    int allocateBookId();
+    int allocateUserId();
+};
+
+IdAllocator::IdAllocator(const string &file)
+{
+    filename = file;
+    nextBookId = 1;
+    nextUserId = 1;
+}
+
+bool IdAllocator::load()
+{
+    ifstream metaFile(filename);
+    if (!metaFile.is_open())
+    {
+        return false;
+    }
+
+    string line;
+    while (getline(metaFile, line))
+    {
+        size_t eq = line.find('=');
+        if (eq == string::npos)
+            continue;
+
+        string_view key = trimField(string_view(line).substr(0, eq));
+        int value;
+        if (!parseInt(trimField(string_view(line).substr(eq + 1)), value))
+            continue;
+
+        if (key == "next_book_id")
+            nextBookId = max<long long>(nextBookId, value);
+        else if (key == "next_user_id")
+            nextUserId = max<long long>(nextUserId, value);
+    }
+    metaFile.close();
+    return true;
+}
+
+bool IdAllocator::save() const
+{
+    AtomicFileWriter metaFile(filename);
+    metaFile.write("next_book_id=" + to_string(nextBookId) + "\n");
+    metaFile.write("next_user_id=" + to_string(nextUserId) + "\n");
+
+    if (!metaFile.commit())
+    {
+        cerr << "Error: Could not write ID metadata file!" << endl;
+        return false;
+    }
+    return true;
+}
+
+void IdAllocator::reserveBookIds(int highestUsed)
+{
+    if (highestUsed >= nextBookId)
+    {
+        nextBookId = highestUsed + 1LL;
+    }
+}
+
+void IdAllocator::reserveUserIds(int highestUsed)
+{
+    if (highestUsed >= nextUserId)
+    {
+        nextUserId = highestUsed + 1LL;
+    }
+}
+
+int IdAllocator::allocateBookId()
+{
+    if (nextBookId > numeric_limits<int>::max())
+    {
+        return 0;
+    }
+    return static_cast<int>(nextBookId++);
+}
+
+int IdAllocator::allocateUserId()
+{
+    if (nextUserId > numeric_limits<int>::max())
+    {
+        return 0;
+    }
+    return static_cast<int>(nextUserId++);
+}
+
+// SHA-256 as specified in FIPS 180-4. It is only used to derive password
+// hashes, so it favours being short over being fast.
+class Sha256
+{
+private:
+    uint32_t state[8];
+    uint8_t block[64];
+    size_t blockUsed;
+    uint64_t totalBytes;
+
+    void compress(const uint8_t *data);
+
+public:
+    Sha256();
+
+    void update(const void *data, size_t size);
+    void finish(uint8_t digest[32]);
+};
+
+Sha256::Sha256()
+{
+    static const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(state, initial, sizeof(state));
+    blockUsed = 0;
+    totalBytes = 0;
+}
+
+void Sha256::compress(const uint8_t *data)
+{
+    static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+    auto rotate = [](uint32_t x, int n) { return (x >> n) | (x << (32 - n)); };
+
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = (uint32_t(data[i * 4]) << 24) | (uint32_t(data[i * 4 + 1]) << 16) |
+               (uint32_t(data[i * 4 + 2]) << 8) | uint32_t(data[i * 4 + 3]);
+    }
+    for (int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = rotate(w[i - 15], 7) ^ rotate(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotate(w[i - 2], 17) ^ rotate(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t t1 = h + (rotate(e, 6) ^ rotate(e, 11) ^ rotate(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+        uint32_t t2 = (rotate(a, 2) ^ rotate(a, 13) ^ rotate(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void Sha256::update(const void *data, size_t size)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    totalBytes += size;
+    while (size > 0)
+    {
+        size_t take = min(size, sizeof(block) - blockUsed);
+        memcpy(block + blockUsed, bytes, take);
+        blockUsed += take;
+        bytes += take;
+        size -= take;
+        if (blockUsed == sizeof(block))
+        {
+            compress(block);
+            blockUsed = 0;
+        }
+    }
+}
+
+void Sha256::finish(uint8_t digest[32])
+{
+    uint64_t bits = totalBytes * 8;
+    uint8_t padding[72] = {0x80};
+    size_t padSize = (blockUsed < 56) ? 56 - blockUsed : 120 - blockUsed;
+    for (int i = 0; i < 8; i++)
+    {
+        padding[padSize + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+    }
+    update(padding, padSize + 8);
+
+    for (int i = 0; i < 8; i++)
+    {
+        digest[i * 4] = static_cast<uint8_t>(state[i] >> 24);
+        digest[i * 4 + 1] = static_cast<uint8_t>(state[i] >> 16);
+        digest[i * 4 + 2] = static_cast<uint8_t>(state[i] >> 8);
+        digest[i * 4 + 3] = static_cast<uint8_t>(state[i]);
+    }
+}
+
+// PBKDF2 (RFC 8018) with HMAC-SHA256, producing a single 32-byte block. The
+// HMAC key pads are hashed once up front, so each iteration costs exactly
+// two compressions.
+void pbkdf2Sha256(string_view password, string_view salt, int iterations, uint8_t derived[32])
+{
+    uint8_t key[64] = {};
+    if (password.size() > sizeof(key))
+    {
+        Sha256 keyHash;
+        keyHash.update(password.data(), password.size());
+        keyHash.finish(key);
+    }
+    else
+    {
+        memcpy(key, password.data(), password.size());
+    }
+
+    uint8_t pad[64];
+    Sha256 inner, outer;
+    for (size_t i = 0; i < sizeof(pad); i++)
+        pad[i] = key[i] ^ 0x36;
+    inner.update(pad, sizeof(pad));
+    for (size_t i = 0; i < sizeof(pad); i++)
+        pad[i] = key[i] ^ 0x5c;
+    outer.update(pad, sizeof(pad));
+
+    auto hmac = [&](const void *message, size_t size, uint8_t mac[32])
+    {
+        Sha256 hash = inner;
+        hash.update(message, size);
+        hash.finish(mac);
+        hash = outer;
+        hash.update(mac, 32);
+        hash.finish(mac);
+    };
+
+    const uint8_t blockIndex[4] = {0, 0, 0, 1};
+    Sha256 first = inner;
+    first.update(salt.data(), salt.size());
+    first.update(blockIndex, sizeof(blockIndex));
+    uint8_t u[32];
+    first.finish(u);
+    Sha256 firstOuter = outer;
+    firstOuter.update(u, sizeof(u));
+    firstOuter.finish(u);
+
+    memcpy(derived, u, sizeof(u));
+    for (int i = 1; i < iterations; i++)
+    {
+        hmac(u, sizeof(u), u);
+        for (size_t j = 0; j < sizeof(u); j++)
+            derived[j] ^= u[j];
+    }
+}
+
+string toHex(const uint8_t *bytes, size_t size)
+{
+    static const char digits[] = "0123456789abcdef";
+    string hex;
+    for (size_t i = 0; i < size; i++)
+    {
+        hex += digits[bytes[i] >> 4];
+        hex += digits[bytes[i] & 15];
+    }
+    return hex;
+}
+
+bool fromHex(string_view hex, uint8_t *bytes, size_t size)
+{
+    if (hex.size() != size * 2)
+        return false;
+
+    for (size_t i = 0; i < hex.size(); i++)
+    {
+        char c = hex[i];
+        int nibble = isdigit(static_cast<unsigned char>(c)) ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+        if (nibble < 0)
+            return false;
+        bytes[i / 2] = static_cast<uint8_t>((i % 2 == 0) ? nibble << 4 : bytes[i / 2] | nibble);
+    }
+    return true;
+}
+
+const char passwordScheme[] = "pbkdf2-sha256$";
+
+bool isPasswordHash(string_view credential)
+{
+    return credential.substr(0, sizeof(passwordScheme) - 1) == passwordScheme;
+}
+
+// Stored as "pbkdf2-sha256$<iterations>$<salt>$<hash>" with the salt and
+// hash in hex. Each hash records its own work factor, so raising the
+// default never invalidates existing passwords.
+string hashPassword(string_view password, int iterations)
+{
+    uint8_t salt[16];
+    random_device random;
+    for (size_t i = 0; i < sizeof(salt); i += 4)
+    {
+        uint32_t word = random();
+        memcpy(salt + i, &word, 4);
+    }
+
+    uint8_t derived[32];
+    pbkdf2Sha256(password, string_view(reinterpret_cast<char *>(salt), sizeof(salt)), iterations, derived);
+    return passwordScheme + to_string(iterations) + "$" + toHex(salt, sizeof(salt)) + "$" +
+           toHex(derived, sizeof(derived));
+}
+
+// Compares every byte of the hash whatever the first difference, so the
+// time taken says nothing about how close the guess was. iterations is set
+// to the stored work factor.
+bool verifyPassword(string_view password, string_view credential, int &iterations)
+{
+    string_view fields[4];
+    size_t count = 0;
+    size_t begin = 0;
+    while (count < 4)
+    {
+        size_t end = credential.find('$', begin);
+        fields[count++] = credential.substr(begin, end - begin);
+        if (end == string_view::npos)
+            break;
+        begin = end + 1;
+    }
+
+    uint8_t salt[16];
+    uint8_t expected[32];
+    if (!isPasswordHash(credential) || count != 4 || !parseInt(fields[1], iterations) || iterations < 1 ||
+        !fromHex(fields[2], salt, sizeof(salt)) || !fromHex(fields[3], expected, sizeof(expected)))
+    {
+        return false;
+    }
+
+    uint8_t derived[32];
+    pbkdf2Sha256(password, string_view(reinterpret_cast<char *>(salt), sizeof(salt)), iterations, derived);
+    uint8_t difference = 0;
+    for (size_t i = 0; i < sizeof(derived); i++)
+    {
+        difference |= derived[i] ^ expected[i];
+    }
+    return difference == 0;
+}
+
+bool parseRole(string_view text, UserRole &role)
+{
+    if (text == "ADMIN")
+        role = ADMIN;
+    else if (text == "FACULTY")
+        role = FACULTY;
+    else if (text == "STUDENT")
+        role = STUDENT;
+    else
+        return false;
+    return true;
+}
+
+const char *roleName(UserRole role)
+{
+    return (role == ADMIN) ? "ADMIN" : (role == FACULTY) ? "FACULTY" : "STUDENT";
+}
+
+// One row per patron, holding both the login account and the borrowing
+// record. Patrons without a username cannot log in.
+struct Person
+{
+    int id;
+    string username;
+    string name;
+    UserRole role;
+    string credential;
+    long long feeCents;
+    int feesThrough;
+};
+
+// The patrons.txt layout: "ID, Username, Name, Role, Password, Late Fees,
+// Fees Through". A patron without an accrual date has never been accrued,
+// so their fees are counted from each loan's due date. Unknown roles fall
+// back to STUDENT, as logins always have.
+bool parsePatron(const string_view *fields, size_t count, Person &person)
+{
+    if (count != 7 || !parseInt(fields[0], person.id) || person.id <= 0)
+    {
+        return false;
+    }
+
+    person.username.assign(fields[1]);
+    person.name.assign(fields[2]);
+    if (!parseRole(fields[3], person.role))
+        person.role = STUDENT;
+    person.credential.assign(fields[4]);
+    person.feeCents = 0;
+    person.feesThrough = 0;
+    parseCents(fields[5], person.feeCents);
+    if (!fields[6].empty())
+    {
+        parseDate(fields[6], person.feesThrough);
+    }
+    return true;
+}
+
+string formatPatron(const Person &person)
+{
+    return to_string(person.id) + ", \"" + person.username + "\", \"" + person.name + "\", \"" +
+           roleName(person.role) + "\", \"" + person.credential + "\", \"" + formatCents(person.feeCents) +
+           "\", \"" + (person.feesThrough > 0 ? formatDate(person.feesThrough) : "") + "\"";
+}
+
+// Reads a row of the People.txt that older versions kept: the
+// "ID, Name, Role, Late Fees, Fees Through" layout, the earlier one without
+// the accrual date, or the seven-column one that also carried the loans.
+// Only the name, role and fees are filled in.
+bool parseLegacyPerson(const string_view *fields, size_t count, Person &person)
+{
+    if (count < 4 || !parseInt(fields[0], person.id) || person.id <= 0)
+    {
+        return false;
+    }
+
+    person.username.clear();
+    person.name.assign(fields[1]);
+    person.role = (fields[2] == "Faculty") ? FACULTY : STUDENT;
+    person.credential.clear();
+    person.feeCents = 0;
+    person.feesThrough = 0;
+    parseCents(fields[count >= 7 ? 6 : 3], person.feeCents);
+    if (count == 5 && !fields[4].empty())
+    {
+        parseDate(fields[4], person.feesThrough);
+    }
+    return true;
+}
+
+// Reads a row of the users.txt that older versions kept:
+// "ID, Username, Role, Password". The name is the username until the
+// matching People.txt row supplies one.
+bool parseLegacyAccount(const string_view *fields, size_t count, Person &person)
+{
+    if (count < 4 || !parseInt(fields[0], person.id) || person.id <= 0 || fields[1].empty())
+    {
+        return false;
+    }
+
+    person.username.assign(fields[1]);
+    person.name.assign(fields[1]);
+    if (!parseRole(fields[2], person.role))
+        person.role = STUDENT;
+    person.credential.assign(fields[3]);
+    person.feeCents = 0;
+    person.feesThrough = 0;
+    return true;
+}
+
+struct Loan
+{
+    int userId;
+    int bookId;
+    int borrowedDay;
+    int dueDay;
+};
+
+bool parseLoan(const string_view *fields, size_t count, Loan &loan)
+{
+    return count >= 4 && parseInt(fields[0], loan.userId) && parseInt(fields[1], loan.bookId) &&
+           parseDate(fields[2], loan.borrowedDay) && parseDate(fields[3], loan.dueDay);
+}
+
+string formatLoan(const Loan &loan)
+{
+    return to_string(loan.userId) + ", " + to_string(loan.bookId) + ", \"" + formatDate(loan.borrowedDay) +
+           "\", \"" + formatDate(loan.dueDay) + "\"";
+}
+
+// Older People.txt files kept every loan of a patron in one
+// "Title (id), Title (id)" column with a single borrow and due date. Pull
+// the book IDs back out of that string so the loans can be migrated.
+void parseLegacyLoans(string_view borrowed, const Loan &shared, vector<Loan> &loans)
+{
+    size_t close = borrowed.find(')');
+    while (close != string_view::npos)
+    {
+        size_t open = borrowed.rfind('(', close);
+        Loan loan = shared;
+        if (open != string_view::npos && parseInt(borrowed.substr(open + 1, close - open - 1), loan.bookId))
+        {
+            loans.push_back(loan);
+        }
+        close = borrowed.find(')', close + 1);
+    }
+}
+
+// One record per outstanding loan, addressed by (user, book). Loans are
+// split by user into shards, each behind its own mutex, so borrows and
+// returns by different patrons never wait for one another and checking
+// for a duplicate borrow or finding the loan to return only looks at the
+// patron's own shard. Within a shard each user's and each book's loans are
+// indexed separately, and an ordered index by due date lets the overdue
+// report skip loans that are not yet late.
+class LoanStore
+{
+private:
+    static const size_t shardCount = 64;
+
+    struct Shard
+    {
+        mutable mutex lock;
+        vector<Loan> loans;
+        unordered_map<uint64_t, size_t> slotByKey;
+        unordered_map<int, vector<int>> booksByUser;
+        unordered_map<int, vector<int>> usersByBook;
+        set<pair<int, uint64_t>> byDueDate;
+    };
+
+    string filename;
+    Shard shards[shardCount];
+    atomic<size_t> count;
+    LoadStats lastLoad;
+
+    static uint64_t key(int userId, int bookId);
+    Shard &shardOf(int userId);
+    const Shard &shardOf(int userId) const;
+
+public:
+    explicit LoanStore(const string &file = "loans.txt");
+
+    bool load();
+    bool save() const;
+    const LoadStats &loadStats() const;
+    bool add(const Loan &loan);
+    bool remove(int userId, int bookId, Loan *removed = nullptr);
+    bool find(int userId, int bookId) const;
+
+    template <typename Visitor>
+    void forEach(Visitor visit) const;
+    template <typename Visitor>
+    void forEachOfUser(int userId, Visitor visit) const;
+    template <typename Visitor>
+    void forEachOverdue(int today, Visitor visit) const;
+    size_t countForBook(int bookId) const;
+    size_t size() const;
+};
+
+LoanStore::LoanStore(const string &file)
+{
+    filename = file;
+    count = 0;
+}
+
+uint64_t LoanStore::key(int userId, int bookId)
+{
+    return (static_cast<uint64_t>(static_cast<uint32_t>(userId)) << 32) | static_cast<uint32_t>(bookId);
+}
+
+LoanStore::Shard &LoanStore::shardOf(int userId)
+{
+    return shards[static_cast<uint32_t>(userId) % shardCount];
+}
+
+const LoanStore::Shard &LoanStore::shardOf(int userId) const
+{
+    return shards[static_cast<uint32_t>(userId) % shardCount];
+}
+
+bool LoanStore::load()
+{
+    for (Shard &shard : shards)
+    {
+        lock_guard<mutex> guard(shard.lock);
+        shard.loans.clear();
+        shard.slotByKey.clear();
+        shard.booksByUser.clear();
+        shard.usersByBook.clear();
+        shard.byDueDate.clear();
+    }
+    count = 0;
+
+    return loadLinesParallel<Loan>(filename, "User ID", [](string_view line, Loan &loan)
+    {
+        string_view fields[4];
+        return parseLoan(fields, splitRecord(line, fields, 4), loan);
+    },
+    [&](const vector<Loan> &rows, const vector<string_view> &rejected)
+    {
+        for (string_view line : rejected)
+        {
+            cerr << "Warning: Invalid loan record skipped - " << line << endl;
+        }
+        for (const auto &loan : rows)
+        {
+            if (!add(loan))
+                cerr << "Warning: Invalid loan record skipped - " << formatLoan(loan) << endl;
+        }
+    }, lastLoad);
+}
+
+const LoadStats &LoanStore::loadStats() const
+{
+    return lastLoad;
+}
+
+bool LoanStore::save() const
+{
+    AtomicFileWriter loansOut(filename);
+    if (!loansOut.isOpen())
+    {
+        cerr << "Error: Could not open loans file for writing!" << endl;
+        return false;
+    }
+
+    loansOut.write("\"User ID\", \"Book ID\", \"Borrowed\", \"Due Date\"\n");
+    forEach([&](const Loan &loan)
+    {
+        loansOut.write(formatLoan(loan));
+        loansOut.write("\n");
+    });
+
+    if (!loansOut.commit())
+    {
+        cerr << "Error: Could not save loans file! The previous version was kept." << endl;
+        return false;
+    }
+    return true;
+}
+
+// Fails if the user already has this book, so of two concurrent borrows of
+// the same book by the same user only one gets in.
+bool LoanStore::add(const Loan &loan)
+{
+    if (loan.userId <= 0 || loan.bookId <= 0)
+    {
+        return false;
+    }
+
+    Shard &shard = shardOf(loan.userId);
+    lock_guard<mutex> guard(shard.lock);
+    if (!shard.slotByKey.emplace(key(loan.userId, loan.bookId), shard.loans.size()).second)
+    {
+        return false;
+    }
+
+    shard.loans.push_back(loan);
+    shard.booksByUser[loan.userId].push_back(loan.bookId);
+    shard.usersByBook[loan.bookId].push_back(loan.userId);
+    shard.byDueDate.emplace(loan.dueDay, key(loan.userId, loan.bookId));
+    count++;
+    return true;
+}
+
+// Copies the loan to removed, if given, before dropping it. Of two
+// concurrent returns of the same loan only one finds it.
+bool LoanStore::remove(int userId, int bookId, Loan *removed)
+{
+    Shard &shard = shardOf(userId);
+    lock_guard<mutex> guard(shard.lock);
+    auto found = shard.slotByKey.find(key(userId, bookId));
+    if (found == shard.slotByKey.end())
+    {
+        return false;
+    }
+
+    size_t slot = found->second;
+    if (removed)
+        *removed = shard.loans[slot];
+    shard.slotByKey.erase(found);
+    shard.byDueDate.erase({shard.loans[slot].dueDay, key(userId, bookId)});
+    if (slot != shard.loans.size() - 1)
+    {
+        shard.loans[slot] = move(shard.loans.back());
+        shard.slotByKey[key(shard.loans[slot].userId, shard.loans[slot].bookId)] = slot;
+    }
+    shard.loans.pop_back();
+
+    auto eraseValue = [](unordered_map<int, vector<int>> &index, int owner, int value)
+    {
+        auto list = index.find(owner);
+        list->second.erase(std::find(list->second.begin(), list->second.end(), value));
+        if (list->second.empty())
+            index.erase(list);
+    };
+    eraseValue(shard.booksByUser, userId, bookId);
+    eraseValue(shard.usersByBook, bookId, userId);
+    count--;
+    return true;
+}
+
+bool LoanStore::find(int userId, int bookId) const
+{
+    const Shard &shard = shardOf(userId);
+    lock_guard<mutex> guard(shard.lock);
+    return shard.slotByKey.count(key(userId, bookId)) != 0;
+}
+
+// Visits under each shard's mutex in turn, so visit must not call back into
+// the store.
+template <typename Visitor>
+void LoanStore::forEach(Visitor visit) const
+{
+    for (const Shard &shard : shards)
+    {
+        lock_guard<mutex> guard(shard.lock);
+        for (const auto &loan : shard.loans)
+        {
+            visit(loan);
+        }
+    }
+}
+
+template <typename Visitor>
+void LoanStore::forEachOfUser(int userId, Visitor visit) const
+{
+    const Shard &shard = shardOf(userId);
+    lock_guard<mutex> guard(shard.lock);
+    auto list = shard.booksByUser.find(userId);
+    if (list == shard.booksByUser.end())
+    {
+        return;
+    }
+
+    for (int bookId : list->second)
+    {
+        visit(shard.loans[shard.slotByKey.at(key(userId, bookId))]);
+    }
+}
+
+// Visits loans whose due date is before today, oldest first. They are
+// copied out of the shards first, so visit may use the store.
+template <typename Visitor>
+void LoanStore::forEachOverdue(int today, Visitor visit) const
+{
+    vector<pair<int, Loan>> overdue;
+    for (const Shard &shard : shards)
+    {
+        lock_guard<mutex> guard(shard.lock);
+        for (const auto &entry : shard.byDueDate)
+        {
+            if (entry.first >= today)
+                break;
+            overdue.emplace_back(entry.first, shard.loans[shard.slotByKey.at(entry.second)]);
+        }
+    }
+
+    sort(overdue.begin(), overdue.end(), [](const pair<int, Loan> &a, const pair<int, Loan> &b)
+    {
+        if (a.first != b.first)
+            return a.first < b.first;
+        return key(a.second.userId, a.second.bookId) < key(b.second.userId, b.second.bookId);
+    });
+    for (const auto &entry : overdue)
+    {
+        visit(entry.second);
+    }
+}
+
+size_t LoanStore::countForBook(int bookId) const
+{
+    size_t total = 0;
+    for (const Shard &shard : shards)
+    {
+        lock_guard<mutex> guard(shard.lock);
+        auto list = shard.usersByBook.find(bookId);
+        total += (list == shard.usersByBook.end()) ? 0 : list->second.size();
+    }
+    return total;
+}
+
+size_t LoanStore::size() const
+{
+    return count;
+}
+
+// Every patron in one table, stored densely by user ID so that per-user
+// operations are a direct slot access, with a hash index from username to
+// ID for logins. The dense index only grows while it stays within twice the
+// patron count; IDs far beyond it go to an ordered overflow index instead,
+// so one huge ID cannot force a huge allocation. When a username appears more than once the first row
+// loaded keeps it, which is the account the old linear scan of users.txt
+// matched.
+class PatronTable
+{
+private:
+    string filename;
+    string legacyUsersFile;
+    string legacyPeopleFile;
+    vector<Person> people;
+    vector<int> slotById;
+    map<int, int> outlierSlots;
+    unordered_map<string, int> idByUsername;
+    set<int> owingIds;
+    atomic<size_t> count;
+    bool legacyMigrated;
+    LoadStats lastLoad;
+
+    int slotOf(int id) const;
+    bool loadLegacy(vector<Loan> &legacyLoans);
+    bool hashPlaintext(int iterations);
+
+public:
+    explicit PatronTable(const string &file = "patrons.txt", const string &usersFile = "users.txt",
+                         const string &peopleFile = "People.txt");
+
+    bool load(int iterations, vector<Loan> &legacyLoans);
+    bool save() const;
+    void removeLegacyFiles();
+    const LoadStats &loadStats() const;
+    void upsert(const Person &person);
+    void mergeAccount(const Person &account);
+    void mergeBorrower(const Person &borrower);
+    Person *find(int id);
+    const Person *findByUsername(const string &username) const;
+
+    template <typename Visitor>
+    void forEach(Visitor visit) const;
+    template <typename Visitor>
+    void forEachOwing(Visitor visit) const;
+    int maxId() const;
+    size_t size() const;
+};
+
+PatronTable::PatronTable(const string &file, const string &usersFile, const string &peopleFile)
+{
+    filename = file;
+    legacyUsersFile = usersFile;
+    legacyPeopleFile = peopleFile;
+    count = 0;
+    legacyMigrated = false;
+}
+
+// Without patrons.txt the table is built from the users.txt and People.txt
+// of older versions and saved; the old files are only removed by
+// removeLegacyFiles() once the loans they held are safe too. Plaintext
+// passwords, whether migrated or typed into the file, are hashed and
+// written back straight away.
+bool PatronTable::load(int iterations, vector<Loan> &legacyLoans)
+{
+    people.clear();
+    count = 0;
+    slotById.clear();
+    outlierSlots.clear();
+    idByUsername.clear();
+    owingIds.clear();
+    legacyMigrated = false;
+
+    bool opened = loadLinesParallel<Person>(filename, "ID", [](string_view line, Person &person)
+    {
+        string_view fields[8];
+        return parsePatron(fields, splitRecord(line, fields, 8), person);
+    },
+    [&](const vector<Person> &rows, const vector<string_view> &rejected)
+    {
+        for (const auto &person : rows)
+        {
+            upsert(person);
+        }
+        for (string_view line : rejected)
+        {
+            cerr << "Warning: Invalid patron record format - " << line << endl;
+        }
+    }, lastLoad);
+
+    if (!opened)
+    {
+        if (!loadLegacy(legacyLoans))
+        {
+            cerr << "Error: Could not open patrons file!" << endl;
+            return false;
+        }
+        hashPlaintext(iterations);
+        legacyMigrated = save();
+        return true;
+    }
+
+    if (hashPlaintext(iterations))
+    {
+        save();
+    }
+    return true;
+}
+
+// Rows with the same ID in both files are the same patron: users.txt gives
+// the username, role and password, and People.txt the name and fees.
+bool PatronTable::loadLegacy(vector<Loan> &legacyLoans)
+{
+    struct PersonRow
+    {
+        Person person;
+        vector<Loan> legacyLoans;
+    };
+
+    LoadStats accountStats;
+    bool opened = loadLinesParallel<Person>(legacyUsersFile, "ID", [](string_view line, Person &person)
+    {
+        string_view fields[4];
+        return parseLegacyAccount(fields, splitRecord(line, fields, 4), person);
+    },
+    [&](const vector<Person> &rows, const vector<string_view> &)
+    {
+        for (const auto &account : rows)
+        {
+            mergeAccount(account);
+        }
+    }, accountStats);
+
+    opened = loadLinesParallel<PersonRow>(legacyPeopleFile, "ID", [](string_view line, PersonRow &row)
+    {
+        string_view fields[7];
+        size_t count = splitRecord(line, fields, 7);
+        if (!parseLegacyPerson(fields, count, row.person))
+        {
+            return false;
+        }
+
+        if (count >= 7)
+        {
+            // Rows without usable dates are migrated as if borrowed today.
+            Loan shared = {row.person.id, 0, 0, 0};
+            if (!parseDate(fields[4], shared.borrowedDay) || !parseDate(fields[5], shared.dueDay))
+            {
+                localToday(shared.borrowedDay);
+                shared.dueDay = shared.borrowedDay;
+            }
+            parseLegacyLoans(fields[3], shared, row.legacyLoans);
+        }
+        return true;
+    },
+    [&](const vector<PersonRow> &rows, const vector<string_view> &)
+    {
+        for (const auto &row : rows)
+        {
+            mergeBorrower(row.person);
+            legacyLoans.insert(legacyLoans.end(), row.legacyLoans.begin(), row.legacyLoans.end());
+        }
+    }, lastLoad) || opened;
+
+    lastLoad.bytes += accountStats.bytes;
+    lastLoad.seconds += accountStats.seconds;
+    return opened;
+}
+
+// Hashes on all cores, since each hash is deliberately slow. Returns
+// whether any password was hashed.
+bool PatronTable::hashPlaintext(int iterations)
+{
+    vector<size_t> plaintext;
+    for (size_t slot = 0; slot < people.size(); slot++)
+    {
+        if (!people[slot].credential.empty() && !isPasswordHash(people[slot].credential))
+            plaintext.push_back(slot);
+    }
+    if (plaintext.empty())
+    {
+        return false;
+    }
+
+    atomic<size_t> next(0);
+    auto hashRemaining = [&]()
+    {
+        for (size_t i = next++; i < plaintext.size(); i = next++)
+        {
+            Person &person = people[plaintext[i]];
+            person.credential = hashPassword(person.credential, iterations);
+        }
+    };
+    vector<thread> workers;
+    size_t threads = min<size_t>(max(1u, thread::hardware_concurrency()), plaintext.size());
+    for (size_t t = 1; t < threads; t++)
+    {
+        workers.emplace_back(hashRemaining);
+    }
+    hashRemaining();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    return true;
+}
+
+void PatronTable::removeLegacyFiles()
+{
+    if (!legacyMigrated)
+    {
+        return;
+    }
+
+    remove(legacyUsersFile.c_str());
+    remove(legacyPeopleFile.c_str());
+    legacyMigrated = false;
+}
+
+const LoadStats &PatronTable::loadStats() const
+{
+    return lastLoad;
+}
+
+bool PatronTable::save() const
+{
+    AtomicFileWriter patronsOut(filename);
+    if (!patronsOut.isOpen())
+    {
+        cerr << "Error: Could not save patron records!" << endl;
+        return false;
+    }
+
+    patronsOut.write("\"ID\", \"Username\", \"Name\", \"Role\", \"Password\", \"Late Fees\", \"Fees Through\"\n");
+    forEach([&](const Person &person)
+    {
+        patronsOut.write(formatPatron(person));
+        patronsOut.write("\n");
+    });
+
+    if (!patronsOut.commit())
+    {
+        cerr << "Error: Could not save patron records! The previous version was kept." << endl;
+        return false;
+    }
+    return true;
+}
+
+void PatronTable::upsert(const Person &person)
+{
+    if (person.feeCents > 0)
+        owingIds.insert(person.id);
+    else
+        owingIds.erase(person.id);
+
+    Person *existing = find(person.id);
+    if (existing)
+    {
+        if (existing->username != person.username)
+        {
+            auto named = idByUsername.find(existing->username);
+            if (named != idByUsername.end() && named->second == person.id)
+                idByUsername.erase(named);
+        }
+        *existing = person;
+    }
+    else
+    {
+        const size_t minDenseSlots = 4096;
+
+        int slot = static_cast<int>(people.size());
+        size_t id = static_cast<size_t>(person.id);
+        people.push_back(person);
+        count++;
+        if (id >= slotById.size() && id >= max(minDenseSlots, 2 * people.size()))
+        {
+            outlierSlots[person.id] = slot;
+        }
+        else
+        {
+            if (id >= slotById.size())
+            {
+                slotById.resize(id + 1, -1);
+                while (!outlierSlots.empty() && static_cast<size_t>(outlierSlots.begin()->first) <= id)
+                {
+                    slotById[outlierSlots.begin()->first] = outlierSlots.begin()->second;
+                    outlierSlots.erase(outlierSlots.begin());
+                }
+            }
+            slotById[id] = slot;
+        }
+    }
+
+    if (!person.username.empty())
+    {
+        idByUsername.emplace(person.username, person.id);
+    }
+}
+
+// Applies the account half of a patron from an older users.txt or journal.
+// Each ID keeps the first username it was given, as logins by that name
+// have always matched it first.
+void PatronTable::mergeAccount(const Person &account)
+{
+    Person *existing = find(account.id);
+    if (!existing)
+    {
+        upsert(account);
+        return;
+    }
+    if (!existing->username.empty() && existing->username != account.username)
+    {
+        cerr << "Warning: Ignoring account " << account.username << ", user ID " << account.id
+             << " already belongs to " << existing->username << endl;
+        return;
+    }
+
+    Person merged = *existing;
+    merged.username = account.username;
+    merged.role = account.role;
+    merged.credential = account.credential;
+    upsert(merged);
+}
+
+// Applies the borrowing half of a patron from an older People.txt or
+// journal. A patron with an account keeps the account's role.
+void PatronTable::mergeBorrower(const Person &borrower)
+{
+    Person *existing = find(borrower.id);
+    if (!existing)
+    {
+        upsert(borrower);
+        return;
+    }
+
+    Person merged = *existing;
+    merged.name = borrower.name;
+    if (merged.username.empty())
+        merged.role = borrower.role;
+    merged.feeCents = borrower.feeCents;
+    merged.feesThrough = borrower.feesThrough;
+    upsert(merged);
+}
+
+// Every outlier ID is past the end of the dense index.
+int PatronTable::slotOf(int id) const
+{
+    if (id <= 0)
+    {
+        return -1;
+    }
+    if (static_cast<size_t>(id) < slotById.size())
+    {
+        return slotById[id];
+    }
+
+    auto outlier = outlierSlots.find(id);
+    return outlier == outlierSlots.end() ? -1 : outlier->second;
+}
+
+Person *PatronTable::find(int id)
+{
+    int slot = slotOf(id);
+    return slot < 0 ? nullptr : &people[slot];
+}
+
+const Person *PatronTable::findByUsername(const string &username) const
+{
+    auto found = idByUsername.find(username);
+    return (found == idByUsername.end()) ? nullptr : &people[slotOf(found->second)];
+}
+
+template <typename Visitor>
+void PatronTable::forEach(Visitor visit) const
+{
+    for (int slot : slotById)
+    {
+        if (slot >= 0)
+            visit(people[slot]);
+    }
+    for (const auto &outlier : outlierSlots)
+    {
+        visit(people[outlier.second]);
+    }
+}
+
+template <typename Visitor>
+void PatronTable::forEachOwing(Visitor visit) const
+{
+    for (int id : owingIds)
+    {
+        visit(people[slotOf(id)]);
+    }
+}
+
+int PatronTable::maxId() const
+{
+    if (!outlierSlots.empty())
+    {
+        return outlierSlots.rbegin()->first;
+    }
+    return slotById.empty() ? 0 : static_cast<int>(slotById.size()) - 1;
+}
+
+// Safe to call without the lock that guards the table.
+size_t PatronTable::size() const
+{
+    return count;
+}
+
+// Append-only log of catalog and patron mutations made since the last
+// snapshot of books.txt and patrons.txt. Each record holds the after-image of
+// the rows it changed, so replaying a record that already made it into the
+// snapshot is harmless.
+//
+// Records are handed to the OS as soon as they are appended, and append()
+// returns a ticket that waitDurable() blocks on until the record is synced
+// to disk. A waiter that finds no sync running becomes the leader and syncs
+// everything appended so far; the threads that queue up meanwhile are
+// covered by that sync or by the next leader's, so concurrent writers share
+// syncs without any timer. Tickets number this process's records in order.
+//
+// offset is how far into the file this process has replayed or written.
+// Other processes append to the same file, so replay() picks up from there.
+// writeMutex makes each append and its offset update one step, so threads
+// of this process can append side by side without it looking as if another
+// process had written.
+class Journal
+{
+private:
+    string filename;
+    int fd;
+    atomic<uint64_t> offset;
+    atomic<size_t> records;
+    bool torn;
+    mutable mutex writeMutex;
+
+    mutex syncMutex;
+    condition_variable syncDone;
+    uint64_t appended;
+    uint64_t synced;
+    bool syncing;
+
+    bool openForAppend();
+    uint64_t completeLength() const;
+    bool cutTornTail();
+
+public:
+    explicit Journal(const string &file = "library.journal");
+    ~Journal();
+
+    template <typename Apply>
+    size_t replay(Apply apply);
+    uint64_t append(const string &record);
+    uint64_t append(const string *records, size_t count);
+    bool waitDurable(uint64_t ticket);
+    bool sync();
+    size_t unsynced();
+    bool reset();
+    void rewind();
+    bool hasTornTail() const;
+    bool dropTornTail();
+    bool changedOnDisk() const;
+    size_t size() const;
+};
+
+Journal::Journal(const string &file)
+{
+    filename = file;
+    fd = -1;
+    offset = 0;
+    records = 0;
+    torn = false;
+    appended = 0;
+    synced = 0;
+    syncing = false;
+}
+
+Journal::~Journal()
+{
+    if (fd >= 0)
+    {
+        sync();
+        closeFile(fd);
+    }
+}
+
+// Applies the records after offset and returns how many were applied. A
+// last line without its newline is a record torn by a crash; replay stops
+// in front of it and notes it in torn.
+template <typename Apply>
+size_t Journal::replay(Apply apply)
+{
+    ifstream in(filename, ios::binary);
+    if (!in.is_open())
+    {
+        return 0;
+    }
+    in.seekg(static_cast<streamoff>(offset.load()));
+
+    size_t applied = 0;
+    string line;
+    string_view fields[16];
+    torn = false;
+    while (getline(in, line))
+    {
+        if (in.eof())
+        {
+            torn = true;
+            break;
+        }
+        offset += line.size() + 1;
+        size_t count = splitRecord(line, fields, 16);
+        if (count > 1 && apply(fields, min(count, size_t(16))))
+        {
+            applied++;
+        }
+    }
+    in.close();
+    records += applied;
+    return applied;
+}
+
+bool Journal::openForAppend()
+{
+    fd = openForWriting(filename, true);
+    if (fd < 0)
+    {
+        cerr << "Error: Could not open journal file for writing!" << endl;
+        return false;
+    }
+    if (!cutTornTail())
+    {
+        closeFile(fd);
+        fd = -1;
+        return false;
+    }
+    return true;
+}
+
+// The length of the file up to and including its last newline.
+uint64_t Journal::completeLength() const
+{
+    ifstream in(filename, ios::binary | ios::ate);
+    if (!in.is_open())
+    {
+        return 0;
+    }
+
+    char block[4096];
+    uint64_t end = static_cast<uint64_t>(in.tellg());
+    while (end > 0)
+    {
+        uint64_t start = (end > sizeof(block)) ? end - sizeof(block) : 0;
+        in.seekg(static_cast<streamoff>(start));
+        in.read(block, static_cast<streamsize>(end - start));
+        for (uint64_t i = end - start; i > 0; i--)
+        {
+            if (block[i - 1] == '\n')
+                return start + i;
+        }
+        end = start;
+    }
+    return 0;
+}
+
+// A crash can leave a torn last record without its newline. Its writer
+// never heard back that it was saved, so it is cut off rather than
+// completed, which keeps it out of every later replay and puts the next
+// record on a line of its own. Callers hold dataLock exclusively or for
+// appending, so no record can be half written at the time.
+bool Journal::cutTornTail()
+{
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0)
+    {
+        return true;
+    }
+
+    uint64_t length = static_cast<uint64_t>(info.st_size);
+    uint64_t complete = completeLength();
+    if (complete == length)
+    {
+        return true;
+    }
+    if (!truncateFile(fd, complete))
+    {
+        cerr << "Error: Could not remove a torn record from the journal file!" << endl;
+        return false;
+    }
+    offset = min<uint64_t>(offset, complete);
+    torn = false;
+    return true;
+}
+
+uint64_t Journal::append(const string &record)
+{
+    return append(&record, 1);
+}
+
+// Writes the records with one write call and returns the ticket of the
+// last, or 0 if they could not be written. Callers hold dataLock
+// exclusively or for appending.
+uint64_t Journal::append(const string *lines, size_t count)
+{
+    string block;
+    for (size_t i = 0; i < count; i++)
+    {
+        block += lines[i];
+        block += '\n';
+    }
+
+    lock_guard<mutex> write(writeMutex);
+    if (fd < 0 && !openForAppend())
+    {
+        return 0;
+    }
+    if (!writeAll(fd, block))
+    {
+        cerr << "Error: Could not write to journal file!" << endl;
+        return 0;
+    }
+    offset += block.size();
+    records += count;
+
+    lock_guard<mutex> lock(syncMutex);
+    appended += count;
+    return appended;
+}
+
+// Returns once the record with this ticket is on disk, or false if the sync
+// that should have covered it failed. Needs no other lock, and should be
+// called without any, so that writers queue up behind the running sync
+// instead of behind the locks.
+bool Journal::waitDurable(uint64_t ticket)
+{
+    unique_lock<mutex> lock(syncMutex);
+    while (synced < ticket)
+    {
+        if (syncing)
+        {
+            syncDone.wait(lock);
+            continue;
+        }
+
+        syncing = true;
+        uint64_t target = appended;
+        int file = fd;
+        lock.unlock();
+        bool ok = syncFile(file);
+        lock.lock();
+        syncing = false;
+        if (ok)
+            synced = max(synced, target);
+        syncDone.notify_all();
+        if (!ok)
+        {
+            cerr << "Error: Could not sync journal file!" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Journal::sync()
+{
+    uint64_t ticket;
+    {
+        lock_guard<mutex> lock(syncMutex);
+        ticket = appended;
+    }
+    return waitDurable(ticket);
+}
+
+// How many appended records are not known to be on disk yet.
+size_t Journal::unsynced()
+{
+    lock_guard<mutex> lock(syncMutex);
+    return static_cast<size_t>(appended - synced);
+}
+
+bool Journal::reset()
+{
+    lock_guard<mutex> write(writeMutex);
+    if (fd < 0 && !openForAppend())
+    {
+        return false;
+    }
+
+    if (!truncateFile(fd, 0) || !syncFile(fd))
+    {
+        cerr << "Error: Could not truncate journal file!" << endl;
+        return false;
+    }
+    offset = 0;
+    records = 0;
+
+    // The snapshots now hold everything the journal did.
+    lock_guard<mutex> lock(syncMutex);
+    synced = appended;
+    syncDone.notify_all();
+    return true;
+}
+
+// Forgets what has been replayed, so the next replay() starts from the top.
+void Journal::rewind()
+{
+    offset = 0;
+    records = 0;
+}
+
+// True if the last replay() stopped at a torn record.
+bool Journal::hasTornTail() const
+{
+    return torn;
+}
+
+// Cuts off the torn record the last replay() stopped at. Callers hold
+// dataLock exclusively, so no writer can be part way through it.
+bool Journal::dropTornTail()
+{
+    lock_guard<mutex> write(writeMutex);
+    if (fd < 0)
+    {
+        return openForAppend();
+    }
+    return cutTornTail();
+}
+
+// True if the file is not the length this process last saw, meaning another
+// process has appended to it or compacted it.
+bool Journal::changedOnDisk() const
+{
+    lock_guard<mutex> write(writeMutex);
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0)
+    {
+        return offset != 0;
+    }
+    return static_cast<uint64_t>(info.st_size) != offset;
+}
+
+size_t Journal::size() const
+{
+    return records;
+}
+
+// Advisory reader/writer lock on library.lock, shared by every process that
+// opens the data files. It meets the BasicLockable and shared lockable
+// requirements, so unique_lock and shared_lock work with it. The OS lock is
+// held by the process as a whole; readers counts this process's threads
+// that share it.
+//
+// A third mode, taken with lock_append(), holds the OS lock exclusively on
+// behalf of several threads at once, so the threads of one process can
+// commit side by side while other processes are still kept out. Appenders
+// exclude this process's readers and exclusive writers. Once one of those
+// is waiting, or a run of appenders has gone on long enough, new appenders
+// wait for the run to end, so the OS lock is released now and then.
+//
+// The file also holds the compaction epoch. A compaction rewrites the data
+// files and empties the journal, so a process that sees a new epoch must
+// reload everything; otherwise replaying the journal's new records is
+// enough.
+class DataLock
+{
+private:
+    string filename;
+    int fd;
+    mutex localMutex;
+    condition_variable released;
+    int readers;
+    int appenders;
+    size_t appendRun;
+    int waiting;
+    bool writing;
+    mutable mutex epochMutex;
+
+public:
+    explicit DataLock(const string &file = "library.lock");
+    ~DataLock();
+
+    void lock();
+    void unlock();
+    void lock_shared();
+    void unlock_shared();
+    void lock_append();
+    void unlock_append();
+    uint64_t epoch() const;
+    bool setEpoch(uint64_t value);
+};
+
+DataLock::DataLock(const string &file)
+{
+    filename = file;
+    readers = 0;
+    appenders = 0;
+    appendRun = 0;
+    waiting = 0;
+    writing = false;
+    fd = openForLocking(filename);
+    if (fd < 0)
+    {
+        cerr << "Warning: Could not open " << filename << "; other instances will not see this one's changes.\n";
+    }
+}
+
+DataLock::~DataLock()
+{
+    if (fd >= 0)
+    {
+        closeFile(fd);
+    }
+}
+
+void DataLock::lock()
+{
+    unique_lock<mutex> guard(localMutex);
+    waiting++;
+    released.wait(guard, [this]() { return !writing && readers == 0 && appenders == 0; });
+    waiting--;
+    writing = true;
+    guard.unlock();
+
+    if (fd >= 0 && !lockFile(fd, true))
+        cerr << "Warning: Could not lock " << filename << ": " << strerror(errno) << "\n";
+}
+
+void DataLock::unlock()
+{
+    if (fd >= 0)
+        unlockFile(fd);
+
+    lock_guard<mutex> guard(localMutex);
+    writing = false;
+    released.notify_all();
+}
+
+// The first reader takes the OS lock while still holding localMutex, so no
+// other thread can count itself in before the lock is actually held.
+void DataLock::lock_shared()
+{
+    unique_lock<mutex> guard(localMutex);
+    waiting++;
+    released.wait(guard, [this]() { return !writing && appenders == 0; });
+    waiting--;
+    if (readers++ == 0 && fd >= 0 && !lockFile(fd, false))
+        cerr << "Warning: Could not lock " << filename << ": " << strerror(errno) << "\n";
+}
+
+void DataLock::unlock_shared()
+{
+    lock_guard<mutex> guard(localMutex);
+    if (--readers == 0)
+    {
+        if (fd >= 0)
+            unlockFile(fd);
+        released.notify_all();
+    }
+}
+
+// Like lock_shared(), the first appender takes the OS lock while holding
+// localMutex.
+void DataLock::lock_append()
+{
+    const size_t maxAppendRun = 256;
+
+    unique_lock<mutex> guard(localMutex);
+    released.wait(guard, [this]() { return !writing && readers == 0 && waiting == 0 && appendRun < maxAppendRun; });
+    appendRun++;
+    if (appenders++ == 0 && fd >= 0 && !lockFile(fd, true))
+        cerr << "Warning: Could not lock " << filename << ": " << strerror(errno) << "\n";
+}
+
+void DataLock::unlock_append()
+{
+    lock_guard<mutex> guard(localMutex);
+    if (--appenders == 0)
+    {
+        if (fd >= 0)
+            unlockFile(fd);
+        appendRun = 0;
+        released.notify_all();
+    }
+}
+
+uint64_t DataLock::epoch() const
+{
+    char text[20];
+    lock_guard<mutex> guard(epochMutex);
+    uint64_t value = 0;
+    if (fd < 0 || !readAt(fd, text, sizeof(text), 0) ||
+        from_chars(text, text + sizeof(text), value).ec != errc())
+    {
+        return 0;
+    }
+    return value;
+}
+
+// Written in place at a fixed width, because replacing the file would give
+// it a new inode and split the processes across two different locks.
+bool DataLock::setEpoch(uint64_t value)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%020llu\n", static_cast<unsigned long long>(value));
+    lock_guard<mutex> guard(epochMutex);
+    return fd >= 0 && writeAt(fd, string_view(text, 21), 0);
+}
+
+struct Session
+{
+    int userId = 0;
+    string username;
+    UserRole role = STUDENT;
+};
+
+// Every service call reports whether it succeeded and, if not, a message
+// meant for whoever made the request.
+struct ServiceResult
+{
+    bool ok = false;
+    string error;
+};
+
+struct LoginResult : ServiceResult
+{
+    Session session;
+};
+
+struct BookResult : ServiceResult
+{
+    Book book{};
+};
+
+struct LoanResult : ServiceResult
+{
+    Loan loan{};
+    string title;
+};
+
+struct BorrowedBook
+{
+    Loan loan;
+    string title;
+};
+
+struct BorrowedResult : ServiceResult
+{
+    vector<BorrowedBook> books;
+    long long feeCents = 0;
+    int today = 0;
+};
+
+// Patrons owing fees, with their password hashes cleared.
+struct FeesResult : ServiceResult
+{
+    vector<Person> owing;
+};
+
+// Title substring matches in ID order, then the remaining keyword matches on
+// title or author, best ranked first.
+struct SearchResult
+{
+    vector<Book> matches;
+    vector<Book> related;
+};
+
+struct BookPage
+{
+    vector<Book> books;
+    int next = 0;
+};
+
+// PBKDF2 iterations for new password hashes. Each one costs two SHA-256
+// compressions, so this sets how long a login takes.
+const int defaultHashIterations = 100000;
+
+// Settings the service needs while it loads, since loading may already hash
+// migrated passwords and write journal records.
+// With groupCommitRecords above 1, calls return before their journal
+// records are on disk, and the journal is synced once that many records are
+// waiting. The caller must then call sync() before it reports any result as
+// done, as batch mode does before writing its output. With the default of
+// 1, every call that changes something waits for its own record, and
+// concurrent calls share syncs.
+struct ServiceOptions
+{
+    int hashIterations = defaultHashIterations;
+    size_t groupCommitRecords = 1;
+};
+
+// The library without any user interface. Callers pass the Session returned
+// by login or signup, and every call returns its outcome as a result struct
+// instead of printing it, so the console, batch mode and anything embedding
+// the library share one implementation.
+class LibraryService
+{
+private:
+    static const size_t stripeCount = 64;
+
+    // The catalog is never changed in place. Readers take the current
+    // version with atomic_load and keep it alive for as long as they use
+    // it; writers copy it, change the copy and publish that with
+    // atomic_store, so catalog reads never wait on a lock.
+    shared_ptr<const Catalog> catalog;
+    PatronTable people;
+    LoanStore loans;
+    IdAllocator ids;
+    Journal journal;
+    DataLock dataLock;
+    atomic<uint64_t> epoch;
+    CopyCounters copies;
+    int feesAccruedThrough;
+    int hashIterations;
+    size_t groupCommitRecords;
+
+    // catalogMutex admits one catalog writer at a time, so two versions are
+    // never built from the same base. recordMutex guards the patrons and
+    // IDs. Every commit holds dataLock, which orders it against the other
+    // processes: borrows and returns hold it for appending, side by side,
+    // and everything else holds it exclusively. bookStripes keep each book's
+    // journal records in the order its copy counter moved, so the last record
+    // for a book holds its final count. The loans and the journal lock
+    // themselves. The locks are taken in the order catalogMutex, dataLock,
+    // bookStripes, recordMutex.
+    mutex catalogMutex;
+    mutable mutex recordMutex;
+    mutex bookStripes[stripeCount];
+    atomic<bool> compactDue;
+
+    // The ticket of the last journal record the calling thread wrote and
+    // has not yet waited for.
+    static thread_local uint64_t unsyncedTicket;
+
+    // Declared ahead of the locks in methods that commit, so that they wait
+    // for their records to reach disk, and run any compaction their commits
+    // made due, only once the locks are released.
+    struct FinishCommits
+    {
+        LibraryService &service;
+        ~FinishCommits() { service.finishCommits(); }
+    };
+
+    // Held while catalog and patron changes are made and recorded. If
+    // another process has committed since this one last caught up, current
+    // is false and the caller must refresh and try again.
+    struct RecordLock
+    {
+        unique_lock<DataLock> file;
+        lock_guard<mutex> record;
+        bool current;
+
+        explicit RecordLock(LibraryService &service)
+            : file(service.dataLock), record(service.recordMutex), current(service.isCurrent())
+        {
+        }
+    };
+
+    // Held by borrows and returns, which any number of this process's
+    // threads may make at once. current means the same as in RecordLock.
+    struct LoanLock
+    {
+        DataLock &file;
+        bool current;
+
+        explicit LoanLock(LibraryService &service) : file(service.dataLock)
+        {
+            file.lock_append();
+            current = service.isCurrent();
+        }
+        ~LoanLock() { file.unlock_append(); }
+    };
+
+    mutex &stripeOf(int bookId);
+    shared_ptr<const Catalog> currentCatalog() const;
+    void publish(shared_ptr<Catalog> next);
+    bool applyJournalRecord(const string_view *fields, size_t count, shared_ptr<Catalog> &draft);
+    void commit(const string &record);
+    void commit(const string *records, size_t count);
+    void reload();
+    bool isCurrent() const;
+    void replayNewCommits();
+    void catchUp();
+    void refresh(bool wait);
+    void publishEpoch();
+    void saveAll();
+    void finishCommits();
+    void compactIfDue();
+    void accrueFees(int userId, int today);
+    void accrueAllFees(int today);
+    void createDefaultFiles();
+    bool checkFileExists(const string &filename);
+
+public:
+    explicit LibraryService(const ServiceOptions &options = ServiceOptions());
+
+    LoginResult login(const string &username, const string &password);
+    LoginResult signup(const string &username, const string &password);
+    BookPage listBooks(int afterId, size_t limit);
+    size_t bookCount();
+    BookResult findBook(int bookId);
+    SearchResult search(string_view text);
+    BookResult addBook(const Session &session, Book book);
+    vector<BookResult> addBooks(const Session &session, vector<Book> books);
+    BookResult editBook(const Session &session, Book updated, int seenCopies);
+    BookResult removeBook(const Session &session, int bookId);
+    LoanResult borrow(const Session &session, int bookId);
+    LoanResult returnBook(const Session &session, int bookId);
+    BorrowedResult borrowedBooks(const Session &session);
+    FeesResult lateFees(const Session &session);
+
+    void sync();
+    void compact();
+    bool convertCatalog(bool toBinary);
+    void printLoadStats() const;
+    static long long calculateLateFees(int dueDay, int today, UserRole role);
+    static string cleanString(const string &input);
+};
+
+thread_local uint64_t LibraryService::unsyncedTicket = 0;
+
+LibraryService::LibraryService(const ServiceOptions &options) : catalog(make_shared<const Catalog>())
+{
+    epoch = 0;
+    feesAccruedThrough = 0;
+    hashIterations = options.hashIterations;
+    groupCommitRecords = max<size_t>(options.groupCommitRecords, 1);
+    compactDue = false;
+
+    unique_lock<DataLock> fileLock(dataLock);
+    lock_guard<mutex> record(recordMutex);
+    if ((!checkFileExists("books.txt") && !checkFileExists("books.bin")) ||
+        (!checkFileExists("patrons.txt") && (!checkFileExists("People.txt") || !checkFileExists("users.txt"))))
+    {
+        createDefaultFiles();
+    }
+    reload();
+    if (journal.hasTornTail())
+        journal.dropTornTail();
+}
+
+// Loads the data files and replays the whole journal over them into a new
+// catalog version, which readers see only once it is complete. Loading can
+// rewrite the patron and loan files to migrate them, so callers hold
+// catalogMutex, recordMutex and an exclusive dataLock.
+void LibraryService::reload()
+{
+    auto next = make_shared<Catalog>();
+    next->load();
+    copies.reset();
+
+    vector<Loan> legacyLoans;
+    people.load(hashIterations, legacyLoans);
+    bool loansSaved = loans.load();
+    if (!loansSaved)
+    {
+        for (const auto &loan : legacyLoans)
+        {
+            loans.add(loan);
+        }
+        loansSaved = loans.save();
+    }
+    if (loansSaved)
+    {
+        people.removeLegacyFiles();
+    }
+
+    epoch = dataLock.epoch();
+    journal.rewind();
+    journal.replay([&](const string_view *fields, size_t count)
+    {
+        return applyJournalRecord(fields, count, next);
+    });
+    feesAccruedThrough = 0;
+
+    ids.load();
+    ids.reserveUserIds(people.maxId());
+    ids.reserveBookIds(next->maxId());
+    publish(move(next));
+}
+
+// Needs no lock. Without dataLock the answer is only a hint, which is all
+// refresh() needs.
+bool LibraryService::isCurrent() const
+{
+    return epoch == dataLock.epoch() && !journal.changedOnDisk();
+}
+
+mutex &LibraryService::stripeOf(int bookId)
+{
+    return bookStripes[static_cast<uint32_t>(bookId) % stripeCount];
+}
+
+shared_ptr<const Catalog> LibraryService::currentCatalog() const
+{
+    return atomic_load(&catalog);
+}
+
+void LibraryService::publish(shared_ptr<Catalog> next)
+{
+    atomic_store(&catalog, shared_ptr<const Catalog>(move(next)));
+}
+
+// Applies whatever other processes have committed since this one last
+// looked. Callers hold catalogMutex, recordMutex and dataLock exclusively,
+// or in shared mode if the epoch has not moved, since only then is there
+// nothing to reload.
+void LibraryService::replayNewCommits()
+{
+    if (epoch != dataLock.epoch())
+    {
+        reload();
+        return;
+    }
+
+    if (journal.changedOnDisk())
+    {
+        shared_ptr<Catalog> draft;
+        journal.replay([&](const string_view *fields, size_t count)
+        {
+            return applyJournalRecord(fields, count, draft);
+        });
+        if (draft)
+            publish(move(draft));
+    }
+}
+
+// Callers hold catalogMutex. New records are replayed under a shared lock.
+// A reload, and cutting off a torn record left by a crash, which would keep
+// the journal looking changed forever, take the lock exclusively.
+void LibraryService::catchUp()
+{
+    {
+        shared_lock<DataLock> fileLock(dataLock);
+        lock_guard<mutex> record(recordMutex);
+        if (epoch == dataLock.epoch())
+        {
+            replayNewCommits();
+            if (!journal.hasTornTail())
+                return;
+        }
+    }
+
+    unique_lock<DataLock> fileLock(dataLock);
+    lock_guard<mutex> record(recordMutex);
+    replayNewCommits();
+    if (journal.hasTornTail())
+        journal.dropTornTail();
+}
+
+// Called without any lock held before a call reads the shared state. The
+// check is cheap, so only calls that find another process's commits pay
+// for catching up. Readers that do not wait keep the version they have
+// while a writer is busy building the next one.
+void LibraryService::refresh(bool wait)
+{
+    if (isCurrent())
+        return;
+
+    unique_lock<mutex> building(catalogMutex, defer_lock);
+    if (wait)
+        building.lock();
+    else if (!building.try_lock())
+        return;
+    catchUp();
+}
+
+// Tells the other processes that the data files were rewritten.
+void LibraryService::publishEpoch()
+{
+    epoch = dataLock.epoch() + 1;
+    if (!dataLock.setEpoch(epoch))
+    {
+        cerr << "Warning: Could not update library.lock; other instances may miss this save.\n";
+    }
+}
+
+// Catalog records go into draft, which is copied from the current version
+// the first time a record needs it, so a replay publishes at most one new
+// version however many books it touches.
+bool LibraryService::applyJournalRecord(const string_view *fields, size_t count, shared_ptr<Catalog> &draft)
+{
+    string_view op = fields[0];
+
+    if (op == "add" || op == "edit")
+    {
+        Book book;
+        if (!parseBook(fields + 1, count - 1, book))
+            return false;
+        if (!draft)
+            draft = make_shared<Catalog>(*currentCatalog());
+        draft->upsert(book);
+        copies.set(book.id, book.copies);
+        ids.reserveBookIds(book.id);
+        return true;
+    }
+
+    if (op == "remove")
+    {
+        int bookId;
+        if (!parseInt(fields[1], bookId))
+            return false;
+        if (!draft)
+            draft = make_shared<Catalog>(*currentCatalog());
+        draft->remove(bookId);
+        copies.set(bookId, 0);
+        return true;
+    }
+
+    // Journals written before users.txt and People.txt were merged hold
+    // half a patron per record: "user" records and five-field "patron"
+    // records.
+    if (op == "patron")
+    {
+        Person person;
+        if (parsePatron(fields + 1, count - 1, person))
+            people.upsert(person);
+        else if (parseLegacyPerson(fields + 1, count - 1, person))
+            people.mergeBorrower(person);
+        else
+            return false;
+        ids.reserveUserIds(person.id);
+        return true;
+    }
+
+    if (op == "user")
+    {
+        Person account;
+        if (!parseLegacyAccount(fields + 1, count - 1, account))
+            return false;
+        people.mergeAccount(account);
+        ids.reserveUserIds(account.id);
+        return true;
+    }
+
+    if (op == "borrow" || op == "return")
+    {
+        int bookId, remaining, userId;
+        Loan loan;
+        if (count < 4 || !parseInt(fields[1], bookId) || !parseInt(fields[2], remaining) ||
+            !parseInt(fields[3], userId))
+            return false;
+        if (op == "borrow" && !parseLoan(fields + 3, count - 3, loan))
+            return false;
+
+        if ((draft ? draft->contains(bookId) : currentCatalog()->contains(bookId)))
+            copies.set(bookId, remaining);
+        if (op == "borrow")
+            loans.add(loan);
+        else
+            loans.remove(userId, bookId);
+        return true;
+    }
+
+    return false;
+}
+
+// Every mutation is applied in memory first and then recorded as one journal
+// line. Once the journal outgrows the data it describes, it is folded into
+// fresh snapshots, which keeps the rewrite cost amortized per mutation.
+void LibraryService::commit(const string &record)
+{
+    commit(&record, 1);
+}
+
+void LibraryService::commit(const string *records, size_t count)
+{
+    const size_t minCompactRecords = 1024;
+
+    uint64_t ticket = journal.append(records, count);
+    if (ticket == 0)
+    {
+        cerr << "Warning: " << (count == 1 ? "This change" : "These changes")
+             << " could not be written to the journal.\n";
+        return;
+    }
+    unsyncedTicket = ticket;
+
+    if (journal.size() > max(minCompactRecords, currentCatalog()->size() + people.size() + loans.size()))
+    {
+        compactDue = true;
+    }
+}
+
+void LibraryService::compact()
+{
+    lock_guard<mutex> building(catalogMutex);
+    unique_lock<DataLock> fileLock(dataLock);
+    lock_guard<mutex> record(recordMutex);
+    replayNewCommits();
+    saveAll();
+}
+
+void LibraryService::finishCommits()
+{
+    uint64_t ticket = unsyncedTicket;
+    unsyncedTicket = 0;
+    if (ticket != 0 && (groupCommitRecords == 1 || journal.unsynced() >= groupCommitRecords) &&
+        !journal.waitDurable(ticket))
+    {
+        cerr << "Warning: A change may not have reached the disk.\n";
+    }
+    compactIfDue();
+}
+
+// Waits until every journal record this process has written is on disk.
+void LibraryService::sync()
+{
+    unsyncedTicket = 0;
+    journal.sync();
+}
+
+void LibraryService::compactIfDue()
+{
+    if (compactDue.exchange(false))
+    {
+        compact();
+    }
+}
+
+// Folds the journal into the data files. Callers hold catalogMutex,
+// recordMutex and an exclusive dataLock and have caught up, so the files
+// include every process's commits and no counter moves while it is saved.
+void LibraryService::saveAll()
+{
+    if (journal.size() == 0)
+    {
+        return;
+    }
+
+    if (currentCatalog()->save(copies) && people.save() && loans.save() && ids.save())
+    {
+        journal.reset();
+        publishEpoch();
+    }
+    else
+    {
+        journal.sync();
+    }
+}
+
+void LibraryService::printLoadStats() const
+{
+    lock_guard<mutex> record(recordMutex);
+    auto print = [](const char *name, const LoadStats &stats)
+    {
+        double megabytes = stats.bytes / 1e6;
+        double rate = (stats.seconds > 0) ? megabytes / stats.seconds : 0;
+        printf("%-10s %10.1f MB %10.1f ms %3u threads %10.1f MB/s\n", name, megabytes, stats.seconds * 1000.0,
+               stats.threads, rate);
+    };
+    print("books", currentCatalog()->loadStats());
+    print("patrons", people.loadStats());
+    print("loans", loans.loadStats());
+}
+
+// Rewrites the catalog in the other format with the journal folded in.
+// Because books.bin takes precedence, going back to CSV removes it.
+bool LibraryService::convertCatalog(bool toBinary)
+{
+    lock_guard<mutex> building(catalogMutex);
+    unique_lock<DataLock> fileLock(dataLock);
+    lock_guard<mutex> record(recordMutex);
+    replayNewCommits();
+    auto next = make_shared<Catalog>(*currentCatalog());
+    next->setBinary(toBinary);
+    if (!next->save(copies))
+    {
+        return false;
+    }
+    publish(move(next));
+    saveAll();
+    publishEpoch();
+
+    if (!toBinary && remove("books.bin") != 0)
+    {
+        cerr << "Error: books.txt was written but books.bin could not be removed!" << endl;
+        return false;
+    }
+    return true;
+}
+
+string LibraryService::cleanString(const string &input)
+{
+    string cleaned;
+    for (char c : input)
+    {
+        if (c != '\"' && c != '\'' && c != '\\')
+        {
+            cleaned += c;
+        }
+    }
+    cleaned.erase(0, cleaned.find_first_not_of(" \t"));
+    cleaned.erase(cleaned.find_last_not_of(" \t") + 1);
+    return cleaned;
+}
+
+bool LibraryService::checkFileExists(const string &filename)
+{
+    ifstream file(filename);
+    return file.good();
+}
+
+void LibraryService::createDefaultFiles()
+{
+    ofstream booksFile("books.txt");
+    if (booksFile.is_open())
+    {
+        booksFile << "ID,Title,Author,Year,Copies\n";
+
+        booksFile << "1,\"C++ Programming Basics\",\"John Doe\",2019,5\n";
+        booksFile << "2,\"Data Structures and Algorithms\",\"Jane Smith\",2020,3\n";
+        booksFile << "3,\"Introduction to Machine Learning\",\"Alice Brown\",2021,2\n";
+        booksFile << "4,\"Database Management Systems\",\"Robert White\",2018,4\n";
+        booksFile << "5,\"The C++ Standard Library\",\"Bjarne Stroustrup\",2022,6\n";
+        booksFile << "6,\"Artificial Intelligence: A Modern Approach\",\"Stuart Russell\",2021,3\n";
+        booksFile << "7,\"Operating Systems Concepts\",\"Abraham Silberschatz\",2017,5\n";
+        booksFile << "8,\"Computer Networks\",\"Andrew Tanenbaum\",2019,2\n";
+        booksFile << "9,\"Clean Code\",\"Robert C. Martin\",2008,4\n";
+        booksFile << "10,\"The Pragmatic Programmer\",\"Andy Hunt\",1999,2\n";
+        booksFile << "11,\"Design Patterns\",\"Erich Gamma\",1994,3\n";
+        booksFile << "12,\"C++ Concurrency in Action\",\"Anthony Williams\",2020,2\n";
+        booksFile << "13,\"Python for Data Analysis\",\"Wes McKinney\",2018,4\n";
+        booksFile << "14,\"Learning React\",\"Alex Banks\",2022,6\n";
+        booksFile << "15,\"Introduction to Algorithms\",\"Thomas H. Cormen\",2009,5\n";
+        booksFile << "16,\"Hands-On Machine Learning\",\"Aurélien Géron\",2023,3\n";
+        booksFile << "17,\"Deep Learning\",\"Ian Goodfellow\",2016,2\n";
+        booksFile << "18,\"Head First Design Patterns\",\"Eric Freeman\",2004,4\n";
+        booksFile << "19,\"Computer Organization and Design\",\"David A. Patterson\",2021,3\n";
+        booksFile << "20,\"Modern Operating Systems\",\"Andrew S. Tanenbaum\",2018,5\n";
+
+        booksFile.close();
+    }
+
+    // The passwords are hashed when the file is first loaded.
+    ofstream patronsFile("patrons.txt");
+    if (patronsFile.is_open())
+    {
+        patronsFile << "\"ID\", \"Username\", \"Name\", \"Role\", \"Password\", \"Late Fees\", \"Fees Through\"\n";
+        patronsFile << "1, \"admin\", \"Dr. Emily Carter\", \"ADMIN\", \"admin123\", \"$0.00\", \"\"\n";
+        patronsFile << "2, \"faculty1\", \"Prof. Robert Greene\", \"FACULTY\", \"faculty123\", \"$0.00\", \"\"\n";
+        patronsFile << "3, \"student1\", \"student1\", \"STUDENT\", \"student123\", \"$0.00\", \"\"\n";
+        patronsFile.close();
+    }
+
+    ofstream loansFile("loans.txt");
+    if (loansFile.is_open())
+    {
+        loansFile << "\"User ID\", \"Book ID\", \"Borrowed\", \"Due Date\"\n";
+        loansFile.close();
+    }
+}
+
+// Fees are counted in cents so that totals stay exact.
+long long LibraryService::calculateLateFees(int dueDay, int today, UserRole role)
+{
+    int daysLate = today - dueDay;
+    if (daysLate <= 0)
+    {
+        return 0;
+    }
+
+    int feePerDay = (role == FACULTY) ? 50 : 100;
+    return static_cast<long long>(daysLate) * feePerDay;
+}
+
+// Brings a patron's stored balance up to today. Each outstanding loan adds
+// the fee for the days past its due date that have not been counted yet, so
+// the work depends only on that patron's own loans. A day with nothing new
+// to charge only advances the date in memory; replaying from the older date
+// later yields the same balance.
+void LibraryService::accrueFees(int userId, int today)
+{
+    Person *person = people.find(userId);
+    if (!person || person->feesThrough >= today)
+    {
+        return;
+    }
+
+    long long added = 0;
+    loans.forEachOfUser(userId, [&](const Loan &loan)
+    {
+        added += calculateLateFees(max(loan.dueDay, person->feesThrough), today, person->role);
+    });
+
+    Person updated = *person;
+    updated.feeCents += added;
+    updated.feesThrough = today;
+    people.upsert(updated);
+    if (added > 0)
+    {
+        commit("patron, " + formatPatron(updated));
+    }
+}
+
+// Accrues every patron with an overdue loan, at most once per day.
+void LibraryService::accrueAllFees(int today)
+{
+    if (feesAccruedThrough >= today)
+    {
+        return;
+    }
+
+    vector<int> overdueUsers;
+    loans.forEachOverdue(today, [&](const Loan &loan)
+    {
+        overdueUsers.push_back(loan.userId);
+    });
+    sort(overdueUsers.begin(), overdueUsers.end());
+    overdueUsers.erase(unique(overdueUsers.begin(), overdueUsers.end()), overdueUsers.end());
+
+    for (int userId : overdueUsers)
+    {
+        accrueFees(userId, today);
+    }
+    feesAccruedThrough = today;
+}
+
+// Looks the user up by name and checks the password against its hash. The
+// hash is computed outside every lock, since it is meant to be slow. A hash
+// made with a different work factor than the current one is replaced once
+// the password is known to be right.
+LoginResult LibraryService::login(const string &username, const string &password)
+{
+    FinishCommits finish{*this};
+    LoginResult result;
+    refresh(true);
+
+    int userId = 0;
+    string credential;
+    UserRole role = STUDENT;
+    {
+        lock_guard<mutex> lock(recordMutex);
+        const Person *match = people.findByUsername(username);
+        if (match)
+        {
+            userId = match->id;
+            credential = match->credential;
+            role = match->role;
+        }
+    }
+
+    // Unknown names cost as much as wrong passwords, so response times do
+    // not reveal which usernames exist.
+    int iterations = 0;
+    if (userId == 0)
+    {
+        uint8_t ignored[32];
+        pbkdf2Sha256(password, username, hashIterations, ignored);
+    }
+    if (userId == 0 || !verifyPassword(password, credential, iterations))
+    {
+        result.error = "Invalid username or password.";
+        return result;
+    }
+
+    int wanted = hashIterations;
+    if (iterations != wanted)
+    {
+        credential = hashPassword(password, wanted);
+        while (true)
+        {
+            refresh(true);
+            RecordLock record(*this);
+            if (!record.current)
+                continue;
+
+            Person *current = people.find(userId);
+            if (current && current->username == username)
+            {
+                Person updated = *current;
+                updated.credential = credential;
+                people.upsert(updated);
+                commit("patron, " + formatPatron(updated));
+            }
+            break;
+        }
+    }
+
+    result.session = {userId, username, role};
+    result.ok = true;
+    return result;
+}
+
+LoginResult LibraryService::signup(const string &username, const string &password)
+{
+    FinishCommits finish{*this};
+    LoginResult result;
+    string name = cleanString(username);
+    string secret = cleanString(password);
+    if (name.empty() || secret.empty())
+    {
+        result.error = "Username and password must not be empty.";
+        return result;
+    }
+
+    Person person = {0, name, name, STUDENT, hashPassword(secret, hashIterations), 0, 0};
+    while (true)
+    {
+        refresh(true);
+        RecordLock record(*this);
+        if (!record.current)
+            continue;
+
+        if (people.findByUsername(name))
+        {
+            result.error = "Username " + name + " is already taken.";
+            return result;
+        }
+
+        // The row goes through the journal so other processes see it.
+        person.id = ids.allocateUserId();
+        if (person.id == 0)
+        {
+            result.error = "No user IDs are left.";
+            return result;
+        }
+        people.upsert(person);
+        commit("patron, " + formatPatron(person));
+
+        result.session = {person.id, name, STUDENT};
+        result.ok = true;
+        return result;
+    }
+}
+
+BookPage LibraryService::listBooks(int afterId, size_t limit)
+{
+    refresh(false);
+    shared_ptr<const Catalog> books = currentCatalog();
+    BookPage page;
+    page.next = books->forEachAfter(afterId, limit, [&](const Book &book)
+    {
+        page.books.push_back(book);
+        page.books.back().copies = copies.get(book.id, book.copies);
+    });
+    return page;
+}
+
+size_t LibraryService::bookCount()
+{
+    refresh(false);
+    return currentCatalog()->size();
+}
+
+BookResult LibraryService::findBook(int bookId)
+{
+    refresh(false);
+    shared_ptr<const Catalog> books = currentCatalog();
+    BookResult result;
+    if (!books->find(bookId, result.book))
+    {
+        result.error = "Book with ID " + to_string(bookId) + " not found.";
+        return result;
+    }
+
+    result.book.copies = copies.get(bookId, result.book.copies);
+    result.ok = true;
+    return result;
+}
+
+SearchResult LibraryService::search(string_view text)
+{
+    refresh(false);
+    shared_ptr<const Catalog> books = currentCatalog();
+    SearchResult result;
+    vector<int> matches = books->findTitlesContaining(text);
+    Book book{};
+    for (int bookId : matches)
+    {
+        if (books->find(bookId, book))
+        {
+            book.copies = copies.get(bookId, book.copies);
+            result.matches.push_back(book);
+        }
+    }
+    for (int bookId : books->search(text))
+    {
+        if (!binary_search(matches.begin(), matches.end(), bookId) && books->find(bookId, book))
+        {
+            book.copies = copies.get(bookId, book.copies);
+            result.related.push_back(book);
+        }
+    }
+    return result;
+}
+
+// Assigns the next book ID and adds the book to the catalog.
+BookResult LibraryService::addBook(const Session &session, Book book)
+{
+    FinishCommits finish{*this};
+    BookResult result;
+    if (session.userId <= 0 || session.role != ADMIN)
+    {
+        result.error = "You don't have permission to add books.";
+        return result;
+    }
+
+    book.title = cleanString(book.title);
+    book.author = cleanString(book.author);
+
+    lock_guard<mutex> building(catalogMutex);
+    while (true)
+    {
+        catchUp();
+        auto next = make_shared<Catalog>(*currentCatalog());
+
+        RecordLock record(*this);
+        if (!record.current)
+            continue;
+
+        book.id = ids.allocateBookId();
+        if (!next->add(book))
+        {
+            result.error =
+                (book.id == 0) ? "No book IDs are left." : "Could not add book with ID " + to_string(book.id) + ".";
+            return result;
+        }
+
+        publish(move(next));
+        copies.set(book.id, book.copies);
+        commit("add, " + formatBook(book));
+        result.book = book;
+        result.ok = true;
+        return result;
+    }
+}
+
+// Adds the books as one catalog version and one journal write, so an
+// import does not publish a version per book. Returns a result per book,
+// in order.
+vector<BookResult> LibraryService::addBooks(const Session &session, vector<Book> books)
+{
+    FinishCommits finish{*this};
+    vector<BookResult> results(books.size());
+    if (session.userId <= 0 || session.role != ADMIN)
+    {
+        for (BookResult &result : results)
+        {
+            result.error = "You don't have permission to add books.";
+        }
+        return results;
+    }
+
+    for (Book &book : books)
+    {
+        book.title = cleanString(book.title);
+        book.author = cleanString(book.author);
+    }
+
+    lock_guard<mutex> building(catalogMutex);
+    while (true)
+    {
+        catchUp();
+        auto next = make_shared<Catalog>(*currentCatalog());
+
+        RecordLock record(*this);
+        if (!record.current)
+            continue;
+
+        vector<string> records;
+        records.reserve(books.size());
+        for (size_t i = 0; i < books.size(); i++)
+        {
+            Book &book = books[i];
+            book.id = ids.allocateBookId();
+            if (!next->add(book))
+            {
+                results[i].error =
+                    (book.id == 0) ? "No book IDs are left." : "Could not add book with ID " + to_string(book.id) + ".";
+                continue;
+            }
+            records.push_back("add, " + formatBook(book));
+            results[i].book = book;
+            results[i].ok = true;
+        }
+
+        publish(move(next));
+        for (const BookResult &result : results)
+        {
+            if (result.ok)
+                copies.set(result.book.id, result.book.copies);
+        }
+        if (!records.empty())
+            commit(records.data(), records.size());
+        return results;
+    }
+}
+
+// Replaces every field of an existing book with the given after-image.
+// Borrows and returns may have moved the stock since the editor read it as
+// seenCopies, so the stock is changed by the editor's difference rather than
+// overwritten, and the record carries the count that results.
+BookResult LibraryService::editBook(const Session &session, Book updated, int seenCopies)
+{
+    FinishCommits finish{*this};
+    BookResult result;
+    if (session.userId <= 0 || session.role != ADMIN)
+    {
+        result.error = "You don't have permission to edit books.";
+        return result;
+    }
+
+    updated.title = cleanString(updated.title);
+    updated.author = cleanString(updated.author);
+
+    lock_guard<mutex> building(catalogMutex);
+    while (true)
+    {
+        catchUp();
+        shared_ptr<const Catalog> base = currentCatalog();
+        if (!base->contains(updated.id))
+        {
+            result.error = "Book with ID " + to_string(updated.id) + " not found.";
+            return result;
+        }
+
+        // The new version is built before taking the locks, so borrows
+        // and returns only wait for the swap.
+        Book stocked{};
+        base->find(updated.id, stocked);
+        auto next = make_shared<Catalog>(*base);
+        next->upsert(updated);
+
+        RecordLock record(*this);
+        if (!record.current)
+            continue;
+
+        int live = copies.adjust(updated.id, stocked.copies, updated.copies - seenCopies);
+        if (live != updated.copies)
+        {
+            updated.copies = live;
+            next->upsert(updated);
+        }
+        publish(move(next));
+        commit("edit, " + formatBook(updated));
+        result.book = updated;
+        result.ok = true;
+        return result;
+    }
+}
+
+BookResult LibraryService::removeBook(const Session &session, int bookId)
+{
+    FinishCommits finish{*this};
+    BookResult result;
+    if (session.userId <= 0 || session.role != ADMIN)
+    {
+        result.error = "You don't have permission to remove books.";
+        return result;
+    }
+
+    lock_guard<mutex> building(catalogMutex);
+    while (true)
+    {
+        catchUp();
+        shared_ptr<const Catalog> base = currentCatalog();
+        if (!base->find(bookId, result.book))
+        {
+            result.error = "Book with ID " + to_string(bookId) + " not found.";
+            return result;
+        }
+
+        auto next = make_shared<Catalog>(*base);
+        next->remove(bookId);
+
+        RecordLock record(*this);
+        if (!record.current)
+            continue;
+
+        size_t onLoan = loans.countForBook(bookId);
+        if (onLoan > 0)
+        {
+            result.error = "Book with ID " + to_string(bookId) + " cannot be removed while " + to_string(onLoan) +
+                           " copies are on loan.";
+            return result;
+        }
+
+        result.book.copies = copies.get(bookId, result.book.copies);
+        publish(move(next));
+        copies.set(bookId, 0);
+        commit("remove, " + to_string(bookId));
+        result.ok = true;
+        return result;
+    }
+}
+
+// Borrows of different books never wait for one another. The threads of
+// this process share dataLock while they borrow, the loan goes into the
+// patron's own shard of the loan store, and the copy is claimed with
+// compare-and-swap under the book's stripe, which only keeps the records of
+// books in that stripe in order. An empty counter turns the borrow away
+// without any lock.
+LoanResult LibraryService::borrow(const Session &session, int bookId)
+{
+    FinishCommits finish{*this};
+    LoanResult result;
+    if (session.userId <= 0)
+    {
+        result.error = "Login required.";
+        return result;
+    }
+
+    int today;
+    if (!localToday(today))
+    {
+        result.error = "Could not read the current time.";
+        return result;
+    }
+
+    while (true)
+    {
+        refresh(true);
+        Book book;
+        if (currentCatalog()->find(bookId, book) && copies.get(bookId, book.copies) <= 0)
+        {
+            result.error = "No copies available of this book.";
+            return result;
+        }
+
+        LoanLock lock(*this);
+        if (!lock.current)
+            continue;
+
+        if (!currentCatalog()->find(bookId, book))
+        {
+            result.error = "Book with ID " + to_string(bookId) + " not found in the library.";
+            return result;
+        }
+
+        lock_guard<mutex> stripe(stripeOf(bookId));
+        if (loans.find(session.userId, bookId))
+        {
+            result.error = "You have already borrowed this book.";
+            return result;
+        }
+
+        if (!copies.tryTake(bookId, book.copies))
+        {
+            result.error = "No copies available of this book.";
+            return result;
+        }
+
+        Loan loan = {session.userId, bookId, today, today + ((session.role == FACULTY) ? 60 : 30)};
+        loans.add(loan);
+        commit("borrow, " + to_string(bookId) + ", " + to_string(copies.get(bookId, book.copies)) + ", " +
+               formatLoan(loan));
+
+        result.loan = loan;
+        result.title = book.title;
+        result.ok = true;
+        return result;
+    }
+}
+
+LoanResult LibraryService::returnBook(const Session &session, int bookId)
+{
+    FinishCommits finish{*this};
+    LoanResult result;
+    if (session.userId <= 0)
+    {
+        result.error = "You must be logged in to return books.";
+        return result;
+    }
+
+    while (true)
+    {
+        refresh(true);
+        LoanLock lock(*this);
+        if (!lock.current)
+            continue;
+
+        Book book;
+        if (!currentCatalog()->find(bookId, book))
+        {
+            result.error = "Book with ID " + to_string(bookId) + " not found in the library database.";
+            return result;
+        }
+
+        lock_guard<mutex> stripe(stripeOf(bookId));
+        if (!loans.find(session.userId, bookId))
+        {
+            result.error = "You have not borrowed book \"" + book.title + "\" (ID: " + to_string(bookId) + ").";
+            return result;
+        }
+
+        // Settle the days this loan has been late before it stops accruing.
+        int today;
+        if (localToday(today))
+        {
+            lock_guard<mutex> record(recordMutex);
+            accrueFees(session.userId, today);
+        }
+
+        result.title = book.title;
+        loans.remove(session.userId, bookId, &result.loan);
+        copies.give(bookId, book.copies);
+        commit("return, " + to_string(bookId) + ", " + to_string(copies.get(bookId, book.copies)) + ", " +
+               to_string(session.userId));
+        result.ok = true;
+        return result;
+    }
+}
+
+// The caller's outstanding loans with their balance brought up to today.
+BorrowedResult LibraryService::borrowedBooks(const Session &session)
+{
+    FinishCommits finish{*this};
+    BorrowedResult result;
+    if (session.userId <= 0)
+    {
+        result.error = "You must be logged in to view borrowed books.";
+        return result;
+    }
+
+    if (!localToday(result.today))
+    {
+        result.error = "Could not read the current time.";
+        return result;
+    }
+
+    while (true)
+    {
+        refresh(true);
+        RecordLock record(*this);
+        if (!record.current)
+            continue;
+
+        shared_ptr<const Catalog> books = currentCatalog();
+        accrueFees(session.userId, result.today);
+        loans.forEachOfUser(session.userId, [&](const Loan &loan)
+        {
+            Book book;
+            result.books.push_back({loan, books->find(loan.bookId, book) ? book.title : "(removed)"});
+        });
+
+        const Person *person = people.find(session.userId);
+        result.feeCents = person ? person->feeCents : 0;
+        result.ok = true;
+        return result;
+    }
+}
+
+// Admins get every patron who owes fees; anyone else gets only their own
+// balance, and only if it is not zero.
+FeesResult LibraryService::lateFees(const Session &session)
+{
+    FinishCommits finish{*this};
+    FeesResult result;
+    if (session.userId <= 0)
+    {
+        result.error = "Login required.";
+        return result;
+    }
+
+    int today;
+    if (!localToday(today))
+    {
+        result.error = "Could not read the current time.";
+        return result;
+    }
+
+    while (true)
+    {
+        refresh(true);
+        RecordLock record(*this);
+        if (!record.current)
+            continue;
+
+        if (session.role == ADMIN)
+        {
+            accrueAllFees(today);
+            people.forEachOwing([&](const Person &person)
+            {
+                result.owing.push_back(person);
+                result.owing.back().credential.clear();
+            });
+        }
+        else
+        {
+            accrueFees(session.userId, today);
+            const Person *person = people.find(session.userId);
+            if (person && person->feeCents > 0)
+            {
+                result.owing.push_back(*person);
+                result.owing.back().credential.clear();
+            }
+        }
+
+        result.ok = true;
+        return result;
+    }
+}
+
+void appendNumber(string &out, long long value)
+{
+    char digits[24];
+    auto result = to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr - digits);
+}
+
+// Console front end over LibraryService. Each action prompts for its input,
+// makes one service call and prints the result; the menu loops own all
+// navigation, so actions simply return when they are done.
+class Library
+{
+private:
+    LibraryService &service;
+    Session session;
+    string pageBuffer;
+
+    int printBooks(int afterId, size_t pageSize, int &shown);
+    void browseBooks();
+
+public:
+    explicit Library(LibraryService &libraryService);
+
+    bool signup();
+    bool login();
+    void logout();
+    void displayBooks();
+    void searchBooks();
+    void addBook();
+    void editBook();
+    void removeBook();
+    void borrowBook();
+    void returnBook();
+    void checkLateFees();
+    void viewBorrowedBooks(bool pause = true);
+    void showMainMenu();
+    void showUserMenu();
+};
+
+Library::Library(LibraryService &libraryService) : service(libraryService)
+{
+}
+
+bool Library::signup()
+{
+    string username, password;
+
+    cout << "Create your Username: ";
+    cin.ignore();
+    getline(cin, username);
+
+    cout << "Enter your password: ";
+    getline(cin, password);
+
+    LoginResult result = service.signup(username, password);
+    if (!result.ok)
+    {
+        cerr << "Error: " << result.error << "\n";
+        return false;
+    }
+
+    session = result.session;
+    cout << "\nAccount created successfully!\n";
+    cout << "Your ID is " << session.userId << "\n";
+    return true;
+}
+
+bool Library::login()
+{
+    string username, password;
+    cout << "Enter your username: ";
+    cin >> username;
+    cout << "Enter your password: ";
+    cin >> password;
+
+    LoginResult result = service.login(username, password);
+    if (!result.ok)
+    {
+        cerr << result.error << "\n";
+        return false;
+    }
+
+    session = result.session;
+    cout << "\nLogin successful! Welcome " << username << "!\n";
+    return true;
+}
+
+void Library::logout()
+{
+    cout << " Logging out...." << endl;
+    cout << " You have successfully logged out!!" << endl;
+    cout << "**********Goodbye**********" << endl;
+
+    session = Session();
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    this_thread::sleep_for(chrono::seconds(1));
+}
+
+// Formats one page into pageBuffer, which keeps its capacity between pages,
+// and writes it out in one call. Returns the cursor for the next page, or 0
+// after the last one.
+int Library::printBooks(int afterId, size_t pageSize, int &shown)
+{
+    BookPage page = service.listBooks(afterId, pageSize);
+
+    pageBuffer.clear();
+    for (const auto &book : page.books)
+    {
+        pageBuffer += "---------------------------------------------\n Book #";
+        appendNumber(pageBuffer, ++shown);
+        pageBuffer += "\n---------------------------------------------\n ID:              ";
+        appendNumber(pageBuffer, book.id);
+        pageBuffer += "\n Title:           ";
+        pageBuffer += book.title;
+        pageBuffer += "\n Author:          ";
+        pageBuffer += book.author;
+        pageBuffer += "\n Year Published:  ";
+        appendNumber(pageBuffer, book.year);
+        pageBuffer += "\n Available Copies:";
+        appendNumber(pageBuffer, book.copies);
+        pageBuffer += "\n\n";
+    }
+
+    cout.write(pageBuffer.data(), pageBuffer.size());
+    cout.flush();
+    return page.next;
+}
+
+// Shows the catalog a page at a time, so only the pages the user asks for
+// are rendered. Expects the newline left behind by the menu choice and
+// consumes it, leaving nothing pending on cin.
+void Library::browseBooks()
+{
+    const size_t booksPerPage = 10;
+
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    cout << "\n=========== Library Book Collection ===========\n\n";
+
+    if (service.bookCount() == 0)
+    {
+        cout << "No books found in the library.\n";
+    }
+
+    int shown = 0;
+    int cursor = 0;
+    while ((cursor = printBooks(cursor, booksPerPage, shown)) != 0)
+    {
+        cout << "-- Showing " << shown << " of " << service.bookCount()
+             << " books. Press Enter for more, or q to stop: ";
+        string reply;
+        if (!getline(cin, reply) || reply == "q" || reply == "Q")
+            break;
+    }
+
+    cout << "=============================================\n";
+}
+
+void Library::displayBooks()
+{
+    browseBooks();
+
+    if (session.role == ADMIN)
+    {
+        int choice;
+        cout << "\n****** What would you like to do? ******\n";
+        cout << "1. Edit a book\n";
+        cout << "2. Remove a book\n";
+        cout << "3. Add a new book\n";
+        cout << "4. Return to main menu\n";
+        cout << "Enter your choice (1-4): ";
+        cin >> choice;
+
+        switch (choice)
+        {
+        case 1:
+            editBook();
+            break;
+        case 2:
+            removeBook();
+            break;
+        case 3:
+            addBook();
+            break;
+        case 4:
+            break;
+        default:
+            cerr << "Invalid choice. Returning to menu." << endl;
+        }
+    }
+}
+
+void Library::searchBooks()
+{
+    string searchTitle;
+    cout << "Enter book title to search: ";
+    cin.ignore();
+    getline(cin, searchTitle);
+
+    auto printBook = [](const Book &book)
+    {
+        cout << "ID: " << book.id << endl;
+        cout << "Title: " << book.title << endl;
+        cout << "Author: " << book.author << endl;
+        cout << "Year: " << book.year << endl;
+        cout << "Available Copies: " << book.copies << endl;
+        cout << "--------------------------------" << endl;
+    };
+
+    cout << "\n=== Search Results ===\n";
+    SearchResult result = service.search(searchTitle);
+    for (const auto &book : result.matches)
+    {
+        printBook(book);
+    }
+
+    if (!result.related.empty())
+    {
+        cout << "\n=== Related Books (title or author keywords) ===\n";
+    }
+    for (const auto &book : result.related)
+    {
+        printBook(book);
+    }
+
+    if (result.matches.empty() && result.related.empty())
+    {
+        cout << "No matching books found." << endl;
+    }
+
+    cout << "Press Enter to continue...";
+    cin.get();
+}
+
+void Library::addBook()
+{
+    if (session.role != ADMIN)
+    {
+        cerr << "Error: You don't have permission to add books." << endl;
+        return;
+    }
+
+    Book book = {0, "", "", 0, 0};
+    cout << "Adding a new book" << endl;
+    cout << "Enter the title of the book: ";
+    cin.ignore();
+    getline(cin, book.title);
+    cout << "Enter the author of the book: ";
+    getline(cin, book.author);
+    cout << "Enter the year of publication: ";
+    cin >> book.year;
+    cout << "Enter the number of copies available: ";
+    cin >> book.copies;
+
+    BookResult result = service.addBook(session, book);
+    if (result.ok)
+    {
+        cout << "Book successfully added to the library with ID " << result.book.id << "!" << endl;
+    }
+    else
+    {
+        cerr << "Error: " << result.error << endl;
+    }
+
+    cout << "Press Enter to continue...";
+    cin.ignore();
+    cin.get();
+}
+
+void Library::editBook()
+{
+    if (session.role != ADMIN)
+    {
+        cerr << "Error: You don't have permission to edit books." << endl;
+        return;
+    }
+
+    browseBooks();
+
+    int bookId;
+    cout << "Enter the ID of the book you want to edit: ";
+    cin >> bookId;
+    cin.ignore();
+
+    BookResult current = service.findBook(bookId);
+    if (!current.ok)
+    {
+        cerr << current.error << "\n";
+        return;
+    }
+
+    const Book &book = current.book;
+    cout << "\nCurrent Book details:\n";
+    cout << "ID: " << book.id << endl;
+    cout << "Title: " << book.title << endl;
+    cout << "Author: " << book.author << endl;
+    cout << "Year: " << book.year << endl;
+    cout << "Stock: " << book.copies << endl;
+
+    int choice;
+    cout << "\nWhich field would you like to edit?\n";
+    cout << "1. Title\n";
+    cout << "2. Author\n";
+    cout << "3. Year\n";
+    cout << "4. Stock\n";
+    cout << "Enter your choice: ";
+    cin >> choice;
+    cin.ignore();
+
+    Book updated = book;
+    switch (choice)
+    {
+    case 1:
+        cout << "Enter the new title: ";
+        getline(cin, updated.title);
+        break;
+    case 2:
+        cout << "Enter the new author: ";
+        getline(cin, updated.author);
+        break;
+    case 3:
+        cout << "Enter the new year: ";
+        cin >> updated.year;
+        break;
+    case 4:
+        cout << "Enter the new stock: ";
+        cin >> updated.copies;
+        break;
+    default:
+        cerr << "Invalid choice. No changes made." << endl;
+        return;
+    }
+
+    if (!cin)
+    {
+        cin.clear();
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        cerr << "Invalid input. No changes made." << endl;
+        return;
+    }
+
+    BookResult result = service.editBook(session, updated, book.copies);
+    if (result.ok)
+        cout << "\nBook details successfully updated!\n";
+    else
+        cerr << "Error: " << result.error << endl;
+
+    cout << "Press Enter to continue...";
+    cin.ignore();
+    cin.get();
+}
+
+void Library::removeBook()
+{
+    if (session.role != ADMIN)
+    {
+        cerr << "Error: You don't have permission to remove books." << endl;
+        return;
+    }
+
+    browseBooks();
+
+    int bookId;
+    cout << "Enter the ID of the book you want to remove: ";
+    cin >> bookId;
+    cin.ignore();
+
+    BookResult result = service.removeBook(session, bookId);
+    if (!result.ok)
+    {
+        cerr << result.error << "\n";
+        return;
+    }
+    cout << "\nBook \"" << result.book.title << "\" (ID: " << bookId << ") removed successfully!\n";
+
+    cout << "Press Enter to continue...";
+    cin.ignore();
+    cin.get();
+}
+
+void Library::borrowBook()
+{
+    if (session.userId <= 0)
+    {
+        cerr << "Error: Login required\n";
+        return;
+    }
+
+    browseBooks();
+
+    int bookId;
+    const int maxTries = 3;
+    int tries = 0;
+
+    do
+    {
+        cout << "Enter book ID to borrow: ";
+        if (!(cin >> bookId) || bookId <= 0)
+        {
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cerr << "Invalid ID. Enter a positive number";
+            if (++tries < maxTries)
+            {
+                cerr << " (" << maxTries - tries << " tries remaining): ";
+            }
+            else
+            {
+                cerr << ". Returning to menu.\n";
+                return;
+            }
+        }
+        else
+        {
+            break;
+        }
+    } while (tries < maxTries);
+
+    LoanResult result = service.borrow(session, bookId);
+    if (!result.ok)
+    {
+        cerr << "Error: " << result.error << "\n";
+        return;
+    }
+
+    cout << "Successfully borrowed: " << result.title << "\n";
+    cout << "Due date: " << formatDate(result.loan.dueDay) << "\n";
+}
+
+void Library::returnBook()
+{
+    if (session.userId <= 0)
+    {
+        cerr << "Error: You must be logged in to return books." << endl;
+        return;
+    }
+
+    viewBorrowedBooks(false);
+    int bookId;
+    cout << "Enter the ID of the book you want to return: ";
+    cin >> bookId;
+    cin.ignore();
+
+    LoanResult result = service.returnBook(session, bookId);
+    if (!result.ok)
+    {
+        cerr << result.error << endl;
+        return;
+    }
+
+    cout << "\nYou have successfully returned \"" << result.title << "\"!" << endl;
+    cout << "Press Enter to continue...";
+    cin.ignore();
+    cin.get();
+}
+
+void Library::checkLateFees()
+{
+    if (session.role != ADMIN)
+    {
+        cerr << "Error: You don't have permission to view all late fees." << endl;
+        return;
+    }
+
+    FeesResult result = service.lateFees(session);
+    if (!result.ok)
+    {
+        cerr << "Error: " << result.error << "\n";
+        return;
+    }
+
+    cout << "\n=== Users with Late Fees ===\n";
+    if (!result.owing.empty())
+    {
+        cout << "ID\tName\t\t\tLate Fees\n";
+        cout << "----------------------------------------\n";
+    }
+
+    for (const auto &person : result.owing)
+    {
+        cout << person.id << "\t" << person.name;
+        if (person.name.length() < 8)
+            cout << "\t\t\t";
+        else if (person.name.length() < 16)
+            cout << "\t\t";
+        else
+            cout << "\t";
+        cout << formatCents(person.feeCents) << endl;
+    }
+
+    if (result.owing.empty())
+    {
+        cout << "No users have late fees at this time." << endl;
+    }
+
+    cout << "\nPress Enter to continue...";
+    cin.ignore();
+    cin.get();
+}
+
+void Library::viewBorrowedBooks(bool pause)
+{
+    BorrowedResult result = service.borrowedBooks(session);
+    if (!result.ok)
+    {
+        cerr << "Error: " << result.error << endl;
+        return;
+    }
+
+    cout << "\n=== Your Borrowed Books ===\n";
+    for (const auto &borrowed : result.books)
+    {
+        const Loan &loan = borrowed.loan;
+        cout << "Book: " << borrowed.title << " (" << loan.bookId << ")" << endl;
+        cout << "Borrow Date: " << formatDate(loan.borrowedDay) << endl;
+        cout << "Due Date: " << formatDate(loan.dueDay) << endl;
+
+        if (loan.dueDay < result.today)
+        {
+            cout << "Days Overdue: " << result.today - loan.dueDay << endl;
+        }
+        cout << "--------------------------------" << endl;
+    }
+
+    if (result.books.empty())
+    {
+        cout << "You have not borrowed any books." << endl;
+    }
+
+    if (result.feeCents > 0)
+    {
+        cout << "Total Late Fees: " << formatCents(result.feeCents) << endl;
+    }
+
+    if (pause)
+    {
+        cout << "Press Enter to continue...";
+        cin.ignore();
+        cin.get();
+    }
+}
+
+void Library::showMainMenu()
+{
+    while (true)
+    {
+        int choice;
+        cout << "\n========== Library Management System ==========\n";
+        cout << "1. Login\n";
+        cout << "2. Sign Up\n";
+        cout << "3. Exit\n";
+        cout << "Enter your choice (1-3): ";
+
+        if (!(cin >> choice))
+        {
+            if (cin.eof())
+            {
+                service.compact();
+                exit(0);
+            }
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cerr << "Invalid input. Please enter a number.\n";
+            continue;
+        }
+
+        switch (choice)
+        {
+        case 1:
+            if (login())
+                showUserMenu();
+            break;
+        case 2:
+            if (signup())
+                showUserMenu();
+            break;
+        case 3:
+            cout << "Thank you for using the Library Management System. Goodbye!\n";
+            service.compact();
+            exit(0);
+        default:
+            cerr << "Invalid choice. Please try again.\n";
+        }
+    }
+}
+
+// Runs until the user logs out, then returns to the main menu loop.
+void Library::showUserMenu()
+{
+    while (session.userId > 0)
+    {
+        int choice;
+        cout << "\n========== Library Management System ==========\n";
+        cout << "Logged in as: " << session.username;
+
+        if (session.role == ADMIN)
+        {
+            cout << " (Admin)\n";
+            cout << "1. View All Books\n";
+            cout << "2. Search for Books\n";
+            cout << "3. Add a Book\n";
+            cout << "4. Edit a Book\n";
+            cout << "5. Remove a Book\n";
+            cout << "6. View Users with Late Fees\n";
+            cout << "7. View My Borrowed Books\n";
+            cout << "8. Borrow a Book\n";
+            cout << "9. Return a Book\n";
+            cout << "10. Logout\n";
+            cout << "11. Exit\n";
+            cout << "Enter your choice (1-11): ";
+        }
+        else
+        {
+            cout << (session.role == FACULTY ? " (Faculty)\n" : " (Student)\n");
+            cout << "1. View All Books\n";
+            cout << "2. Search for Books\n";
+            cout << "3. View My Borrowed Books\n";
+            cout << "4. Borrow a Book\n";
+            cout << "5. Return a Book\n";
+            cout << "6. Logout\n";
+            cout << "7. Exit\n";
+            cout << "Enter your choice (1-7): ";
+        }
+
+        if (!(cin >> choice))
+        {
+            if (cin.eof())
+            {
+                service.compact();
+                exit(0);
+            }
+            cin.clear();
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            cerr << "Invalid input. Please enter a number.\n";
+            continue;
+        }
+
+        if (session.role == ADMIN)
+        {
+            switch (choice)
+            {
+            case 1:
+                displayBooks();
+                break;
+            case 2:
+                searchBooks();
+                break;
+            case 3:
+                addBook();
+                break;
+            case 4:
+                editBook();
+                break;
+            case 5:
+                removeBook();
+                break;
+            case 6:
+                checkLateFees();
+                break;
+            case 7:
+                viewBorrowedBooks();
+                break;
+            case 8:
+                borrowBook();
+                break;
+            case 9:
+                returnBook();
+                break;
+            case 10:
+                logout();
+                return;
+            case 11:
+                cout << "Goodbye!\n";
+                service.compact();
+                exit(0);
+            default:
+                cerr << "Invalid choice. Try again.\n";
+            }
+        }
+        else
+        {
+            switch (choice)
+            {
+            case 1:
+                displayBooks();
+                break;
+            case 2:
+                searchBooks();
+                break;
+            case 3:
+                viewBorrowedBooks();
+                break;
+            case 4:
+                borrowBook();
+                break;
+            case 5:
+                returnBook();
+                break;
+            case 6:
+                logout();
+                return;
+            case 7:
+                cout << "Goodbye!\n";
+                service.compact();
+                exit(0);
+            default:
+                cerr << "Invalid choice. Try again.\n";
+            }
+        }
+    }
+}
+
+void appendJsonString(string &out, string_view text)
+{
+    out += '\"';
+    for (char c : text)
+    {
+        if (c == '\"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        }
+        else
+        {
+            out += c;
+        }
+    }
+    out += '\"';
+}
+
+void appendJsonIds(string &out, const vector<Book> &books)
+{
+    out += '[';
+    for (size_t i = 0; i < books.size(); i++)
+    {
+        if (i > 0)
+            out += ',';
+        appendNumber(out, books[i].id);
+    }
+    out += ']';
+}
+
+// Reads the title, author, year and copies of an add or edit command,
+// starting at fields[first].
+bool parseBookFields(const string_view *fields, size_t first, Book &book)
+{
+    book.title = string(fields[first]);
+    book.author = string(fields[first + 1]);
+    return parseInt(fields[first + 2], book.year) && parseInt(fields[first + 3], book.copies);
+}
+
+void appendResult(string &out, int lineNumber, string_view command, bool ok, const string &error,
+                  const string &details)
+{
+    out += "{\"line\":";
+    appendNumber(out, lineNumber);
+    out += ",\"op\":";
+    appendJsonString(out, command);
+    out += ok ? ",\"ok\":true" : ",\"ok\":false,\"error\":";
+    if (!ok)
+        appendJsonString(out, error);
+    out += details;
+    out += "}\n";
+}
+
+// Runs one batch command against the service and appends its JSON result
+// line to out. Commands use the same comma-separated layout as the data
+// files:
+//
+//   login, <username>, <password>        logout
+//   borrow, <book id>                    return, <book id>
+//   add, <title>, <author>, <year>, <copies>
+//   edit, <book id>, <title>, <author>, <year>, <copies>
+//   remove, <book id>                    search, <text>
+//   fees
+//
+// The search text is the rest of the line, commas included. The session is
+// updated by login and logout. Returns whether the command succeeded.
+bool runCommand(LibraryService &service, Session &session, string_view line, int lineNumber, string &out)
+{
+    string_view fields[8];
+    size_t count = splitRecord(line, fields, 8);
+    string_view command = fields[0];
+
+    string details;
+    string error;
+    bool ok = false;
+    int id = 0;
+
+    if (command == "login" && count >= 3)
+    {
+        LoginResult result = service.login(string(fields[1]), string(fields[2]));
+        session = result.session;
+        ok = result.ok;
+        error = result.error;
+        if (ok)
+        {
+            details += ",\"user\":";
+            appendNumber(details, session.userId);
+        }
+    }
+    else if (command == "logout")
+    {
+        session = Session();
+        ok = true;
+    }
+    else if (command == "borrow" && count >= 2 && parseInt(fields[1], id))
+    {
+        LoanResult result = service.borrow(session, id);
+        ok = result.ok;
+        error = result.error;
+        if (ok)
+        {
+            details += ",\"book\":";
+            appendNumber(details, id);
+            details += ",\"due\":";
+            appendJsonString(details, formatDate(result.loan.dueDay));
+        }
+    }
+    else if (command == "return" && count >= 2 && parseInt(fields[1], id))
+    {
+        LoanResult result = service.returnBook(session, id);
+        ok = result.ok;
+        error = result.error;
+    }
+    else if ((command == "add" && count >= 5) || (command == "edit" && count >= 6 && parseInt(fields[1], id)))
+    {
+        Book book = {id, "", "", 0, 0};
+        if (!parseBookFields(fields, (command == "add") ? 1 : 2, book))
+        {
+            error = "Year and copies must be whole numbers.";
+        }
+        else
+        {
+            // An edit line states the stock outright, so it counts as a
+            // change from the stock as it stands now.
+            BookResult result;
+            if (command == "add")
+                result = service.addBook(session, book);
+            else
+                result = service.editBook(session, book, service.findBook(id).book.copies);
+            ok = result.ok;
+            error = result.error;
+            if (ok)
+            {
+                details += ",\"book\":";
+                appendNumber(details, result.book.id);
+            }
+        }
+    }
+    else if (command == "remove" && count >= 2 && parseInt(fields[1], id))
+    {
+        BookResult result = service.removeBook(session, id);
+        ok = result.ok;
+        error = result.error;
+    }
+    else if (command == "search" && count >= 2)
+    {
+        string_view text = fields[1];
+        if (count > 2)
+            text = trimField(line.substr(line.find(',') + 1));
+        SearchResult result = service.search(text);
+        ok = true;
+        details += ",\"matches\":";
+        appendJsonIds(details, result.matches);
+        details += ",\"related\":";
+        appendJsonIds(details, result.related);
+    }
+    else if (command == "fees")
+    {
+        FeesResult result = service.lateFees(session);
+        ok = result.ok;
+        error = result.error;
+        if (ok)
+        {
+            details += ",\"fees\":[";
+            for (size_t i = 0; i < result.owing.size(); i++)
+            {
+                details += (i > 0) ? ",{\"user\":" : "{\"user\":";
+                appendNumber(details, result.owing[i].id);
+                details += ",\"name\":";
+                appendJsonString(details, result.owing[i].name);
+                details += ",\"cents\":";
+                appendNumber(details, result.owing[i].feeCents);
+                details += '}';
+            }
+            details += ']';
+        }
+    }
+    else
+    {
+        error = "Unknown command or missing arguments.";
+    }
+
+    appendResult(out, lineNumber, command, ok, error, details);
+    return ok;
+}
+
+// Runs one command per line from in, with no prompts or pauses, and writes
+// one JSON object per command to out. Blank lines and lines starting with
+// '#' are skipped. Consecutive well-formed adds by an admin are handed to
+// addBooks together, so an import publishes one catalog version per run of
+// adds rather than one per book; each line still gets its own result.
+// Results are only written once the journal records behind them are on
+// disk, which is what lets group commit skip the per-call wait. Returns the
+// number of commands that failed.
+int runBatch(LibraryService &service, istream &in, ostream &out)
+{
+    const size_t flushThreshold = 1 << 16;
+    const size_t maxGroupedAdds = 4096;
+
+    Session session;
+    string line;
+    string results;
+    int lineNumber = 0;
+    int failures = 0;
+    vector<Book> adds;
+    vector<int> addLines;
+
+    auto runAdds = [&]()
+    {
+        if (adds.empty())
+            return;
+        vector<BookResult> added = service.addBooks(session, move(adds));
+        string details;
+        for (size_t i = 0; i < added.size(); i++)
+        {
+            details.clear();
+            if (added[i].ok)
+            {
+                details += ",\"book\":";
+                appendNumber(details, added[i].book.id);
+            }
+            else
+            {
+                failures++;
+            }
+            appendResult(results, addLines[i], "add", added[i].ok, added[i].error, details);
+        }
+        adds.clear();
+        addLines.clear();
+    };
+
+    while (getline(in, line))
+    {
+        lineNumber++;
+        string_view command = trimField(line);
+        if (command.empty() || command.front() == '#')
+            continue;
+
+        string_view fields[8];
+        size_t count = splitRecord(line, fields, 8);
+        Book book = {0, "", "", 0, 0};
+        if (fields[0] == "add" && count >= 5 && session.role == ADMIN && parseBookFields(fields, 1, book))
+        {
+            adds.push_back(move(book));
+            addLines.push_back(lineNumber);
+            if (adds.size() >= maxGroupedAdds)
+                runAdds();
+            continue;
+        }
+
+        runAdds();
+        if (!runCommand(service, session, line, lineNumber, results))
+            failures++;
+
+        if (results.size() >= flushThreshold)
+        {
+            service.sync();
+            out.write(results.data(), results.size());
+            results.clear();
+        }
+    }
+
+    runAdds();
+    service.sync();
+    out.write(results.data(), results.size());
+    out.flush();
+    return failures;
+}
+
+#ifndef _WIN32
+// Serves the batch command protocol to many clients at once. Clients send one
+// command per line and get one JSON line back per command, exactly as in
+// batch mode, with a session per connection. A single I/O thread accepts
+// connections, reads and writes sockets and splits input into lines; a fixed
+// pool of workers runs the commands. Each connection has at most one command
+// in flight, so its replies come back in the order it sent them.
+class LibraryServer
+{
+private:
+    struct Connection
+    {
+        int fd = -1;
+        Session session;
+        string input;
+        string output;
+        int lineNumber = 0;
+        bool busy = false;
+        bool peerClosed = false;
+        bool failed = false;
+    };
+
+    struct Job
+    {
+        uint64_t connectionId;
+        Session session;
+        string line;
+        int lineNumber;
+        string reply;
+    };
+
+    LibraryService &service;
+    string socketPath;
+    int listenFd;
+    int wakeFds[2];
+
+    unordered_map<uint64_t, Connection> connections;
+    uint64_t nextConnectionId;
+
+    mutex queueMutex;
+    condition_variable queueReady;
+    deque<Job> pending;
+    bool stopping;
+
+    mutex doneMutex;
+    vector<Job> done;
+
+    static volatile sig_atomic_t stopRequested;
+    static int signalWakeFd;
+
+    static void handleSignal(int);
+    void wake();
+    void workerLoop();
+    void acceptClients();
+    void readClient(Connection &connection);
+    void writeClient(Connection &connection);
+    void dispatch(uint64_t id, Connection &connection);
+    void collectReplies();
+
+public:
+    explicit LibraryServer(LibraryService &libraryService);
+    ~LibraryServer();
+
+    bool listen(const string &address);
+    void run(size_t workerCount);
+};
+
+volatile sig_atomic_t LibraryServer::stopRequested = 0;
+int LibraryServer::signalWakeFd = -1;
+
+LibraryServer::LibraryServer(LibraryService &libraryService) : service(libraryService)
+{
+    listenFd = -1;
+    wakeFds[0] = -1;
+    wakeFds[1] = -1;
+    nextConnectionId = 1;
+    stopping = false;
+}
+
+LibraryServer::~LibraryServer()
+{
+    for (auto &entry : connections)
+    {
+        close(entry.second.fd);
+    }
+    if (listenFd >= 0)
+    {
+        close(listenFd);
+        struct stat info;
+        if (!socketPath.empty() && lstat(socketPath.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+            unlink(socketPath.c_str());
+    }
+    for (int fd : wakeFds)
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+// An address made only of digits is a TCP port on the loopback interface;
+// anything else is the path of a Unix domain socket.
+bool LibraryServer::listen(const string &address)
+{
+    int port = 0;
+    bool tcp = parseInt(address, port);
+    if (tcp && (port <= 0 || port > 65535))
+    {
+        cerr << "Error: Invalid port " << address << "\n";
+        return false;
+    }
+
+    listenFd = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0)
+    {
+        cerr << "Error: Could not create socket: " << strerror(errno) << "\n";
+        return false;
+    }
+
+    int bound;
+    if (tcp)
+    {
+        int reuse = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bound = ::bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    }
+    else
+    {
+        sockaddr_un addr{};
+        if (address.size() >= sizeof(addr.sun_path))
+        {
+            cerr << "Error: Socket path is too long: " << address << "\n";
+            return false;
+        }
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, address.c_str(), address.size() + 1);
+
+        // A socket left behind by an earlier run is replaced; anything else
+        // at that path is someone's file and is left alone.
+        struct stat info;
+        if (lstat(address.c_str(), &info) == 0)
+        {
+            if (!S_ISSOCK(info.st_mode))
+            {
+                cerr << "Error: " << address << " exists and is not a socket\n";
+                return false;
+            }
+            unlink(address.c_str());
+        }
+        bound = ::bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+        if (bound == 0)
+            socketPath = address;
+    }
+
+    if (bound < 0 || ::listen(listenFd, SOMAXCONN) < 0)
+    {
+        cerr << "Error: Could not listen on " << address << ": " << strerror(errno) << "\n";
+        return false;
+    }
+
+    if (pipe(wakeFds) < 0)
+    {
+        cerr << "Error: Could not create wake pipe: " << strerror(errno) << "\n";
+        return false;
+    }
+    for (int fd : {listenFd, wakeFds[0], wakeFds[1]})
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    return true;
+}
+
+void LibraryServer::handleSignal(int)
+{
+    stopRequested = 1;
+    if (signalWakeFd >= 0)
+    {
+        ssize_t ignored = write(signalWakeFd, "s", 1);
+        (void)ignored;
+    }
+}
+
+void LibraryServer::wake()
+{
+    ssize_t ignored = write(wakeFds[1], "w", 1);
+    (void)ignored;
+}
+
+void LibraryServer::workerLoop()
+{
+    while (true)
+    {
+        Job job;
+        {
+            unique_lock<mutex> lock(queueMutex);
+            queueReady.wait(lock, [this]() { return stopping || !pending.empty(); });
+            if (pending.empty())
+            {
+                return;
+            }
+            job = move(pending.front());
+            pending.pop_front();
+        }
+
+        runCommand(service, job.session, job.line, job.lineNumber, job.reply);
 
-    getline(peopleFile, line);
+        {
+            lock_guard<mutex> lock(doneMutex);
+            done.push_back(move(job));
+        }
+        wake();
+    }
+}
 
-    while (getline(peopleFile, line))
+void LibraryServer::acceptClients()
+{
+    while (true)
     {
-        stringstream ss(line);
-        string part;
-        vector<string> parts;
-        bool inQuotes = false;
-        string current;
-
-        for (char c : line)
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0)
         {
-            if (c == '\"')
-            {
-                inQuotes = !inQuotes;
-            }
-            else if (c == ',' && !inQuotes)
-            {
-                parts.push_back(cleanString(current));
-                current.clear();
-            }
-            else
-            {
-                current += c;
-            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                cerr << "Warning: Could not accept connection: " << strerror(errno) << "\n";
+            return;
         }
-        parts.push_back(cleanString(current));
 
-        if (parts.size() >= 7)
-        {
-            string dueDate = parts[5];
-            string roleStr = parts[2];
-            UserRole role = (roleStr == "Faculty") ? FACULTY : STUDENT;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        connections[nextConnectionId++].fd = fd;
+    }
+}
 
-            double lateFees = calculateLateFees(dueDate, role);
-            if (lateFees > 0)
-            {
-                if (!headerShown)
-                {
-                    cout << "ID\tName\t\t\tLate Fees\n";
-                    cout << "----------------------------------------\n";
-                    headerShown = true;
-                }
+void LibraryServer::readClient(Connection &connection)
+{
+    const size_t maxLineBytes = 1 << 16;
+    char buffer[1 << 16];
 
-                cout << parts[0] << "\t" << parts[1];
-                if (parts[1].length() < 8)
-                    cout << "\t\t\t";
-                else if (parts[1].length() < 16)
-                    cout << "\t\t";
-                else
-                    cout << "\t";
-                cout << "$" << lateFees << endl;
+    while (true)
+    {
+        ssize_t n = recv(connection.fd, buffer, sizeof(buffer), 0);
+        if (n > 0)
+        {
+            connection.input.append(buffer, n);
+            if (connection.input.size() > maxLineBytes && connection.input.find('\n') == string::npos)
+            {
+                connection.failed = true;
+                return;
             }
+            continue;
         }
+        if (n == 0)
+        {
+            connection.peerClosed = true;
+        }
+        else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            connection.failed = true;
+        }
+        return;
     }
+}
 
-    peopleFile.close();
-
-    if (!headerShown)
+void LibraryServer::writeClient(Connection &connection)
+{
+    size_t written = 0;
+    while (written < connection.output.size())
     {
-        cout << "No users have late fees at this time." << endl;
+        ssize_t n = send(connection.fd, connection.output.data() + written, connection.output.size() - written,
+                         MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                connection.failed = true;
+            break;
+        }
+        written += n;
     }
+    connection.output.erase(0, written);
+}
 
-    cout << "\nPress Enter to continue...";
-    cin.ignore();
-    cin.get();
-    showUserMenu();
+// Hands the connection's next complete line to the workers, unless one of
+// its commands is still running.
+void LibraryServer::dispatch(uint64_t id, Connection &connection)
+{
+    while (!connection.busy && !connection.failed)
+    {
+        size_t end = connection.input.find('\n');
+        if (end == string::npos)
+        {
+            return;
+        }
+
+        string line = connection.input.substr(0, end);
+        connection.input.erase(0, end + 1);
+        connection.lineNumber++;
+
+        string_view command = trimField(line);
+        if (command.empty() || command.front() == '#')
+            continue;
+
+        connection.busy = true;
+        {
+            lock_guard<mutex> lock(queueMutex);
+            pending.push_back({id, connection.session, move(line), connection.lineNumber, string()});
+        }
+        queueReady.notify_one();
+    }
 }
 
-void Library::viewBorrowedBooks(bool returnToMenu)
+void LibraryServer::collectReplies()
 {
-    if (!is_logged_in)
+    vector<Job> finished;
     {
-        cerr << "Error: You must be logged in to view borrowed books." << endl;
-        return;
+        lock_guard<mutex> lock(doneMutex);
+        finished.swap(done);
     }
 
-    ifstream peopleFile("People.txt");
-    if (!peopleFile.is_open())
+    for (auto &job : finished)
     {
-        cerr << "Error: Could not open people file!" << endl;
-        return;
+        auto found = connections.find(job.connectionId);
+        if (found == connections.end())
+            continue;
+
+        Connection &connection = found->second;
+        connection.session = job.session;
+        connection.output += job.reply;
+        connection.busy = false;
+        writeClient(connection);
+        dispatch(job.connectionId, connection);
     }
+}
 
-    cout << "\n=== Your Borrowed Books ===\n";
-    string line;
-    bool found = false;
+// Runs until SIGINT or SIGTERM, then lets the workers finish the commands
+// already queued before returning.
+void LibraryServer::run(size_t workerCount)
+{
+    signalWakeFd = wakeFds[1];
+    signal(SIGINT, handleSignal);
+    signal(SIGTERM, handleSignal);
 
-    getline(peopleFile, line);
+    vector<thread> workers;
+    for (size_t i = 0; i < workerCount; i++)
+    {
+        workers.emplace_back(&LibraryServer::workerLoop, this);
+    }
 
-    while (getline(peopleFile, line))
+    vector<pollfd> fds;
+    vector<uint64_t> ids;
+    while (!stopRequested)
     {
-        stringstream ss(line);
-        string part;
-        vector<string> parts;
-        bool inQuotes = false;
-        string current;
+        fds.clear();
+        ids.clear();
+        fds.push_back({listenFd, POLLIN, 0});
+        fds.push_back({wakeFds[0], POLLIN, 0});
+        for (auto &entry : connections)
+        {
+            const Connection &connection = entry.second;
+            // Stop reading from a client that is far ahead of its replies.
+            bool backlogged = connection.input.size() >= (1 << 20);
+            short events = (connection.peerClosed || connection.failed || backlogged) ? 0 : POLLIN;
+            if (!connection.output.empty() && !connection.failed)
+                events |= POLLOUT;
+            // poll skips negative descriptors, so an idle hung-up socket does
+            // not spin the loop while its last command runs.
+            fds.push_back({events ? connection.fd : -1, events, 0});
+            ids.push_back(entry.first);
+        }
 
-        for (char c : line)
+        if (poll(fds.data(), fds.size(), -1) < 0)
         {
-            if (c == '\"')
-            {
-                inQuotes = !inQuotes;
-            }
-            else if (c == ',' && !inQuotes)
-            {
-                parts.push_back(cleanString(current));
-                current.clear();
-            }
-            else
+            if (errno == EINTR)
+                continue;
+            cerr << "Error: poll failed: " << strerror(errno) << "\n";
+            break;
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            char drain[256];
+            while (read(wakeFds[0], drain, sizeof(drain)) > 0)
             {
-                current += c;
             }
+            collectReplies();
         }
-        parts.push_back(cleanString(current));
 
-        if (parts.size() >= 7 && stoi(parts[0]) == current_user_id)
+        for (size_t i = 0; i < ids.size(); i++)
         {
-            found = true;
-            cout << "Borrowed Books: " << parts[3] << endl;
-            cout << "Borrow Date: " << parts[4] << endl;
-            cout << "Due Date: " << parts[5] << endl;
+            auto found = connections.find(ids[i]);
+            if (found == connections.end())
+                continue;
 
-            string roleStr = parts[2];
-            UserRole role = (roleStr == "Faculty") ? FACULTY : STUDENT;
-            double lateFees = calculateLateFees(parts[5], role);
+            Connection &connection = found->second;
+            short revents = fds[i + 2].revents;
+            if (revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                readClient(connection);
+                dispatch(ids[i], connection);
+            }
+            if (revents & POLLOUT)
+            {
+                writeClient(connection);
+            }
 
-            if (lateFees > 0)
+            bool drained = connection.peerClosed && !connection.busy && connection.output.empty() &&
+                           connection.input.find('\n') == string::npos;
+            if ((connection.failed && !connection.busy) || drained)
             {
-                cout << "Late Fees: $" << lateFees << endl;
+                close(connection.fd);
+                connections.erase(found);
             }
-            break;
         }
-    }
 
-    peopleFile.close();
+        if (fds[0].revents & POLLIN)
+        {
+            acceptClients();
+        }
+    }
 
-    if (!found)
     {
-        cout << "You have not borrowed any books." << endl;
+        lock_guard<mutex> lock(queueMutex);
+        stopping = true;
     }
-    if (returnToMenu)
+    queueReady.notify_all();
+    for (auto &worker : workers)
     {
-        cout << "Press Enter to continue...";
-        cin.ignore();
-        cin.get();
-        showUserMenu();
+        worker.join();
     }
+    signalWakeFd = -1;
 }
+#endif
 
-void Library::showMainMenu()
+#ifndef LIBRARY_SYSTEM_NO_MAIN
+int main(int argc, char *argv[])
 {
-    if (!checkFileExists("books.txt") || !checkFileExists("People.txt") || !checkFileExists("users.txt"))
-    {
-        createDefaultFiles();
-    }
-
-    while (true)
+    ServiceOptions options;
+    string batchPath;
+    string serveAddress;
+    string convertTo;
+    bool printStats = false;
+    int workers = max(4u, thread::hardware_concurrency());
+
+    for (int i = 1; i < argc; i++)
     {
-        int choice;
-        cout << "\n========== Library Management System ==========\n";
-        cout << "1. Login\n";
-        cout << "2. Sign Up\n";
-        cout << "3. Exit\n";
-        cout << "Enter your choice (1-3): ";
-
-        if (!(cin >> choice))
+        string arg = argv[i];
+        if (arg == "--group-commit" && i + 1 < argc)
         {
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cerr << "Invalid input. Please enter a number.\n";
-            continue;
+            int records = 0;
+            if (!parseInt(argv[++i], records) || records < 1)
+            {
+                cerr << "Usage: --group-commit <records per sync>\n";
+                return 1;
+            }
+            options.groupCommitRecords = records;
         }
-
-        switch (choice)
+        else if (arg == "--hash-iterations" && i + 1 < argc)
         {
-        case 1:
-            login();
-            break;
-        case 2:
-            signup();
-            break;
-        case 3:
-            cout << "Thank you for using the Library Management System. Goodbye!\n";
-            exit(0);
-        default:
-            cerr << "Invalid choice. Please try again.\n";
+            if (!parseInt(argv[++i], options.hashIterations) || options.hashIterations < 1)
+            {
+                cerr << "Usage: --hash-iterations <PBKDF2 iterations>\n";
+                return 1;
+            }
         }
-    }
-}
-
-void Library::showUserMenu()
-{
-    while (is_logged_in)
-    {
-        int choice;
-        cout << "\n========== Library Management System ==========\n";
-        cout << "Logged in as: " << current_username;
-
-        if (current_role == ADMIN)
+        else if (arg == "--batch" && i + 1 < argc)
         {
-            cout << " (Admin)\n";
-            cout << "1. View All Books\n";
-            cout << "2. Search for Books\n";
-            cout << "3. Add a Book\n";
-            cout << "4. Edit a Book\n";
-            cout << "5. Remove a Book\n";
-            cout << "6. View Users with Late Fees\n";
-            cout << "7. View My Borrowed Books\n";
-            cout << "8. Borrow a Book\n";
-            cout << "9. Return a Book\n";
-            cout << "10. Logout\n";
-            cout << "11. Exit\n";
-            cout << "Enter your choice (1-11): ";
+            batchPath = argv[++i];
+        }
+        else if (arg == "--serve" && i + 1 < argc)
+        {
+            serveAddress = argv[++i];
+        }
+        else if (arg == "--workers" && i + 1 < argc)
+        {
+            if (!parseInt(argv[++i], workers) || workers < 1)
+            {
+                cerr << "Usage: --workers <threads>\n";
+                return 1;
+            }
+        }
+        else if (arg == "--stats")
+        {
+            printStats = true;
+        }
+        else if (arg == "--to-binary" || arg == "--to-csv")
+        {
+            convertTo = arg;
         }
         else
         {
-            cout << (current_role == FACULTY ? " (Faculty)\n" : " (Student)\n");
-            cout << "1. View All Books\n";
-            cout << "2. Search for Books\n";
-            cout << "3. View My Borrowed Books\n";
-            cout << "4. Borrow a Book\n";
-            cout << "5. Return a Book\n";
-            cout << "6. Logout\n";
-            cout << "7. Exit\n";
-            cout << "Enter your choice (1-7): ";
+            cerr << "Unknown option: " << arg << "\n";
+            return 1;
         }
+    }
 
-        if (!(cin >> choice))
+    // Only batch mode syncs before it reports results, so only batch mode
+    // may let calls return before their records are on disk.
+    if (options.groupCommitRecords > 1 && batchPath.empty())
+    {
+        cerr << "Error: --group-commit only applies to --batch.\n";
+        return 1;
+    }
+
+    // Options are read first because loading the data files may already
+    // hash migrated passwords and write journal records.
+    LibraryService service(options);
+    if (printStats)
+    {
+        service.printLoadStats();
+    }
+    if (!convertTo.empty())
+    {
+        return service.convertCatalog(convertTo == "--to-binary") ? 0 : 1;
+    }
+
+    if (!serveAddress.empty())
+    {
+#ifdef _WIN32
+        cerr << "Error: Server mode is not supported on this platform.\n";
+        return 1;
+#else
+        LibraryServer server(service);
+        if (!server.listen(serveAddress))
         {
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cerr << "Invalid input. Please enter a number.\n";
-            continue;
+            return 1;
         }
+        cout << "Listening on " << serveAddress << " with " << workers << " workers" << endl;
+        server.run(workers);
+        service.compact();
+        return 0;
+#endif
+    }
 
-        if (current_role == ADMIN)
+    if (!batchPath.empty())
+    {
+        int failures = 0;
+        if (batchPath == "-")
         {
-            switch (choice)
-            {
-            case 1:
-                displayBooks(false);
-                break;
-            case 2:
-                searchBooks();
-                break;
-            case 3:
-                addBook();
-                break;
-            case 4:
-                editBook();
-                break;
-            case 5:
-                removeBook();
-                break;
-            case 6:
-                checkLateFees();
-                break;
-            case 7:
-                viewBorrowedBooks();
-                break;
-            case 8:
-                borrowBook();
-                break;
-            case 9:
-                returnBook();
-                break;
-            case 10:
-                logout();
-                return;
-            case 11:
-                cout << "Goodbye!\n";
-                exit(0);
-            default:
-                cerr << "Invalid choice. Try again.\n";
-            }
+            failures = runBatch(service, cin, cout);
         }
         else
         {
-            switch (choice)
+            ifstream batchFile(batchPath);
+            if (!batchFile.is_open())
             {
-            case 1:
-                displayBooks(false);
-                break;
-            case 2:
-                searchBooks();
-                break;
-            case 3:
-                viewBorrowedBooks();
-                break;
-            case 4:
-                borrowBook();
-                break;
-            case 5:
-                returnBook();
-                break;
-            case 6:
-                logout();
-                return;
-            case 7:
-                cout << "Goodbye!\n";
-                exit(0);
-            default:
-                cerr << "Invalid choice. Try again.\n";
+                cerr << "Error: Could not open batch file " << batchPath << "\n";
+                return 1;
             }
+            failures = runBatch(service, batchFile, cout);
         }
+        service.compact();
+        return failures > 0 ? 2 : 0;
     }
 
-    showMainMenu();
-}
-
-int main()
-{
-    Library lib;
-    lib.showMainMenu();
+    Library console(service);
+    console.showMainMenu();
     return 0;
 }
+#endif
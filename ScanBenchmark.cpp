@@ -0,0 +1,114 @@
+// Microbenchmark for the unindexed title scan used by searchBooks for short
+// patterns. Compares the original approach (copy every title, lowercase it
+// with transform, then string::find) with the in-place scan kernels over a
+// contiguous title buffer.
+//
+// Build: g++ -std=c++17 -O2 -o scan_benchmark ScanBenchmark.cpp
+// Usage: scan_benchmark [titles] [pattern]
+#define LIBRARY_SYSTEM_NO_MAIN
+#include "LibrarySystem_fixed.cpp"
+
+#include "BenchmarkTitles.h"
+
+vector<string> generateTitles(size_t count)
+{
+    mt19937 rng(42);
+    vector<string> titles;
+    titles.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        titles.push_back(generateTitle(rng));
+    }
+    return titles;
+}
+
+template <typename Scan>
+void run(const char *name, size_t bytes, Scan scan)
+{
+    const int rounds = 5;
+    size_t matches = 0;
+    double best = numeric_limits<double>::max();
+
+    for (int r = 0; r < rounds; r++)
+    {
+        auto start = chrono::steady_clock::now();
+        matches = scan();
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        best = min(best, elapsed.count());
+    }
+
+    printf("%-22s %10zu matches %10.3f ms %10.1f MB/s\n", name, matches, best * 1000.0, bytes / best / 1e6);
+}
+
+size_t scanHeap(FindIgnoreCaseKernel kernel, const string &heap, const vector<size_t> &offsets, string_view pattern)
+{
+    size_t matches = 0;
+    size_t pos = 0;
+    while (pos < heap.size() && (pos = kernel(heap, pattern, pos)) != string_view::npos)
+    {
+        size_t entry = upper_bound(offsets.begin(), offsets.end(), pos) - offsets.begin() - 1;
+        matches++;
+        pos = (entry + 1 < offsets.size()) ? offsets[entry + 1] : heap.size();
+    }
+    return matches;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t count = (argc > 1) ? stoul(argv[1]) : 1000000;
+    string pattern = (argc > 2) ? argv[2] : "ta";
+    transform(pattern.begin(), pattern.end(), pattern.begin(), ::tolower);
+
+    vector<string> titles = generateTitles(count);
+    string heap;
+    vector<size_t> offsets;
+    for (const auto &title : titles)
+    {
+        offsets.push_back(heap.size());
+        heap += title;
+        heap += '\n';
+    }
+
+    printf("%zu titles, %.1f MB, pattern \"%s\"\n", count, heap.size() / 1e6, pattern.c_str());
+
+    run("copy+tolower+find", heap.size(), [&]()
+    {
+        size_t matches = 0;
+        for (const auto &title : titles)
+        {
+            string titleLower = title;
+            transform(titleLower.begin(), titleLower.end(), titleLower.begin(), ::tolower);
+            if (titleLower.find(pattern) != string::npos)
+                matches++;
+        }
+        return matches;
+    });
+
+    run("scalar kernel", heap.size(), [&]()
+    {
+        return scanHeap(findIgnoreCaseScalar, heap, offsets, pattern);
+    });
+
+#ifdef LIBRARY_SIMD_SCAN
+    if (__builtin_cpu_supports("sse2"))
+    {
+        run("sse2 kernel", heap.size(), [&]()
+        {
+            return scanHeap(findIgnoreCaseSse2, heap, offsets, pattern);
+        });
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        run("avx2 kernel", heap.size(), [&]()
+        {
+            return scanHeap(findIgnoreCaseAvx2, heap, offsets, pattern);
+        });
+    }
+#endif
+
+    run("dispatched kernel", heap.size(), [&]()
+    {
+        return scanHeap(findIgnoreCase, heap, offsets, pattern);
+    });
+    return 0;
+}